@@ -0,0 +1,274 @@
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include <benchmark/benchmark.h>
+
+#include <common/standard.h>
+#include <parse/tokenizer.h>
+#include <parse/default/block_comment.h>
+#include <parse/default/line_comment.h>
+
+#include <parse_cog/composition.h>
+#include <parse_cog/factory.h>
+
+#include <chp/graph.h>
+#include <chp/synthesize.h>
+#include <interpret_chp/import_cog.h>
+
+#include <flow/func.h>
+#include <flow/module.h>
+#include <flow/synthesize.h>
+
+#include <hse/graph.h>
+#include <hse/elaborator.h>
+#include <hse/encoder.h>
+#include <hse/synthesize.h>
+#include <interpret_hse/import.h>
+
+#include <prs/production_rule.h>
+#include <prs/synthesize.h>
+
+#include <sch/Netlist.h>
+#include <phy/Tech.h>
+#include <phy/Script.h>
+
+using namespace std;
+
+// Benchmarks for each stage of the synthesis pipeline. The chp designs are
+// the ones checked by tests/synthesize.cpp, the hse designs are the half
+// buffer in tests/wchb.cogw and pipelines of handshake buffers. The adder and
+// the pipeline come in scaled up versions. Run from the root of the
+// repository so the designs in tests/ are found. prs::build_netlist needs a techfile, set LM_BENCH_TECH
+// to the path of a tech.py to run it.
+
+const std::filesystem::path TEST_DIR = std::filesystem::absolute(std::filesystem::current_path() / "tests");
+
+// Read a design from tests/, exits if it is missing so that the benchmarks
+// are never run against an empty design
+string readDesign(string filename) {
+	ifstream in((TEST_DIR / filename).string(), ios::in | ios::binary);
+	if (not in) {
+		printf("error: design not found '%s'\n", (TEST_DIR / filename).string().c_str());
+		exit(1);
+	}
+	ostringstream contents;
+	contents << in.rdbuf();
+	return contents.str();
+}
+
+// The dual-rail adder with a WIDTH-bit datapath
+string dsAdder(int width) {
+	string cog = readDesign("ds_adder.cog");
+	size_t pos = cog.find("WIDTH=16");
+	if (pos != string::npos) {
+		cog.replace(pos, 8, "WIDTH=" + std::to_string(width));
+	}
+	return cog;
+}
+
+// A pipeline of four-phase handshake buffers from channel L0 to L<stages>
+string bufferPipeline(int stages) {
+	string cog;
+	for (int i = 0; i < stages; i++) {
+		string L = "L" + std::to_string(i);
+		string R = "L" + std::to_string(i+1);
+		// each stage is braced, otherwise "and" would bind its reset to the
+		// loop of the stage before it
+		if (i != 0) {
+			cog += " and ";
+		}
+		cog += "{\n";
+		cog += R + ".r- and " + L + ".a-\n";
+		cog += "while {\n";
+		cog += "\tawait " + L + ".r\n";
+		cog += "\t" + R + ".r+\n";
+		cog += "\tawait " + R + ".a\n";
+		cog += "\t" + L + ".a+\n";
+		cog += "\tawait ~" + L + ".r\n";
+		cog += "\t" + R + ".r-\n";
+		cog += "\tawait ~" + R + ".a\n";
+		cog += "\t" + L + ".a-\n";
+		cog += "}\n";
+		cog += "}";
+	}
+	return cog + "\n";
+}
+
+template <typename T, typename Import>
+bool parseCog(string name, const string &cog, T &g, Import import) {
+	tokenizer tokens;
+	tokens.register_token<parse::block_comment>(false);
+	tokens.register_token<parse::line_comment>(false);
+	parse_cog::register_syntax(tokens);
+	tokens.insert(name, cog, nullptr);
+
+	tokens.increment(false);
+	tokens.expect<parse_cog::composition>();
+	if (not tokens.decrement(__FILE__, __LINE__)) {
+		return false;
+	}
+	parse_cog::composition syntax(tokens);
+	import(g, syntax, &tokens);
+	g.name = name;
+	return true;
+}
+
+chp::graph loadChp(string name, const string &cog) {
+	chp::graph g;
+	parseCog(name, cog, g, [](chp::graph &g, parse_cog::composition &syntax, tokenizer *tokens) {
+		chp::import_chp(g, syntax, tokens, true);
+	});
+	g.post_process(true, false);
+	g.flatten(false);
+	return g;
+}
+
+hse::graph loadHse(string name, const string &cog) {
+	hse::graph g;
+	parseCog(name, cog, g, [](hse::graph &g, parse_cog::composition &syntax, tokenizer *tokens) {
+		hse::import_hse(g, syntax, tokens, true);
+	});
+	g.post_process(true);
+	g.check_variables();
+	return g;
+}
+
+void BM_SynthesizeFunc(benchmark::State &state, string name, string cog) {
+	chp::graph g = loadChp(name, cog);
+	// the copy is made, and the previous one freed, outside of the timing
+	chp::graph curr;
+	for (auto _ : state) {
+		state.PauseTiming();
+		curr = g;
+		state.ResumeTiming();
+		flow::Func fn = chp::synthesizeFuncFromCHP(curr);
+		benchmark::DoNotOptimize(fn);
+	}
+}
+
+void BM_SynthesizeModule(benchmark::State &state, string name, string cog) {
+	chp::graph g = loadChp(name, cog);
+	flow::Func fn = chp::synthesizeFuncFromCHP(g);
+	for (auto _ : state) {
+		clocked::Module mod = flow::synthesizeModuleFromFunc(fn);
+		benchmark::DoNotOptimize(mod);
+	}
+}
+
+void BM_Elaborate(benchmark::State &state, string name, string cog) {
+	hse::graph g = loadHse(name, cog);
+	// the copy is made, and the previous one freed, outside of the timing
+	hse::graph curr;
+	for (auto _ : state) {
+		state.PauseTiming();
+		curr = g;
+		state.ResumeTiming();
+		hse::elaborate(curr, true, true, false);
+	}
+	state.counters["places"] = g.places.size();
+}
+
+void BM_InsertStateVariables(benchmark::State &state, string name, string cog) {
+	hse::graph g = loadHse(name, cog);
+	hse::elaborate(g, true, true, false);
+	// the copy is made, and the previous one freed, outside of the timing
+	hse::graph curr;
+	for (auto _ : state) {
+		state.PauseTiming();
+		curr = g;
+		state.ResumeTiming();
+		hse::encoder enc;
+		enc.base = &curr;
+		enc.check(false, false);
+		if (not enc.insert_state_variables(20, false, false, false)) {
+			state.SkipWithError("state variable insertion failed");
+			break;
+		}
+	}
+}
+
+// returns false if the graph could not be encoded
+bool encode(hse::graph &g) {
+	hse::elaborate(g, true, true, false);
+	hse::encoder enc;
+	enc.base = &g;
+	enc.check(false, false);
+	return enc.insert_state_variables(20, false, false, false) and enc.conflicts.empty();
+}
+
+void BM_SynthesizeRules(benchmark::State &state, string name, string cog) {
+	hse::graph g = loadHse(name, cog);
+	if (not encode(g)) {
+		state.SkipWithError("state variable insertion failed");
+		return;
+	}
+	for (auto _ : state) {
+		prs::production_rule_set pr;
+		hse::synthesize_rules(&pr, &g, false, false);
+		benchmark::DoNotOptimize(pr);
+	}
+}
+
+void BM_BuildNetlist(benchmark::State &state, string name, string cog) {
+	const char *techPath = std::getenv("LM_BENCH_TECH");
+	if (techPath == nullptr) {
+		state.SkipWithError("set LM_BENCH_TECH to a techfile");
+		return;
+	}
+	phy::Tech tech(techPath, "cells");
+	if (not phy::loadTech(tech)) {
+		state.SkipWithError("unable to load techfile");
+		return;
+	}
+
+	hse::graph g = loadHse(name, cog);
+	if (not encode(g)) {
+		state.SkipWithError("state variable insertion failed");
+		return;
+	}
+	prs::production_rule_set pr;
+	hse::synthesize_rules(&pr, &g, false, false);
+	pr.add_keepers(true, false, 1, false);
+	pr.size_devices(0.1, false);
+
+	for (auto _ : state) {
+		sch::Subckt ckt = prs::build_netlist(tech, pr, false);
+		benchmark::DoNotOptimize(ckt);
+	}
+}
+
+int main(int argc, char **argv) {
+	vector<pair<string, string> > chp;
+	const char *designs[] = {"counter", "buffer", "receiver", "traffic_light", "ds_adder"};
+	for (auto name : designs) {
+		chp.push_back({name, readDesign(string(name) + ".cog")});
+	}
+	for (int width : {64, 256, 1024}) {
+		chp.push_back({"ds_adder" + std::to_string(width), dsAdder(width)});
+	}
+
+	vector<pair<string, string> > hse;
+	hse.push_back({"wchb", readDesign("wchb.cogw")});
+	for (int stages : {1, 2, 4, 6}) {
+		hse.push_back({"pipeline" + std::to_string(stages), bufferPipeline(stages)});
+	}
+
+	for (auto i = chp.begin(); i != chp.end(); i++) {
+		benchmark::RegisterBenchmark(("SynthesizeFunc/" + i->first).c_str(), BM_SynthesizeFunc, i->first, i->second);
+		benchmark::RegisterBenchmark(("SynthesizeModule/" + i->first).c_str(), BM_SynthesizeModule, i->first, i->second);
+	}
+	for (auto i = hse.begin(); i != hse.end(); i++) {
+		benchmark::RegisterBenchmark(("Elaborate/" + i->first).c_str(), BM_Elaborate, i->first, i->second);
+		benchmark::RegisterBenchmark(("InsertStateVariables/" + i->first).c_str(), BM_InsertStateVariables, i->first, i->second);
+		benchmark::RegisterBenchmark(("SynthesizeRules/" + i->first).c_str(), BM_SynthesizeRules, i->first, i->second);
+		benchmark::RegisterBenchmark(("BuildNetlist/" + i->first).c_str(), BM_BuildNetlist, i->first, i->second);
+	}
+
+	benchmark::Initialize(&argc, argv);
+	benchmark::RunSpecifiedBenchmarks();
+	benchmark::Shutdown();
+	return 0;
+}
@@ -16,9 +16,12 @@
 #include <parse_prs/factory.h>
 #include <parse_spice/factory.h>
 
+#include <phy/Script.h>
+
 #include "weaver/builder.h"
 #include "weaver/project.h"
 #include "weaver/cli.h"
+#include "weaver/watch.h"
 #include "format/dot.h"
 
 #include "format/cog.h"
@@ -28,6 +31,7 @@
 #include "format/prs.h"
 #include "format/wv.h"
 #include "format/astg.h"
+#include "format/filetypes.h"
 
 void build_help() {
 	printf("\nUsage: lm build [options] <file>\n");
@@ -39,6 +43,7 @@ void build_help() {
 	printf("    --flow_html   enable HTML table output in debug mode (requires --debug)\n");
 	printf(" -h,--help        display this help text\n");
 	printf(" -p,--progress    display progress information\n");
+	printf(" -j,--jobs <N>    parse sources, lower terms and generate cells on N threads (0 uses every core)\n");
 	printf("\n");
 	printf(" -t,--tech <techfile>    manually specify the technology file and arguments\n");
 	printf(" -c,--cells <celldir>    manually specify the cell directory\n");
@@ -54,6 +59,12 @@ void build_help() {
 	printf("         clocked       strictly use clocked val-rdy logic\n");
 	printf("\n");
 
+	printf(" --no-cache     lower every term from scratch instead of reusing build/cache\n");
+	printf(" --stream       write layouts as they are placed and release them from memory\n");
+	printf(" --profile <file>  write the time, memory and size of every stage to a json report\n");
+	printf(" -w,--watch     rebuild the terms affected by each change to the sources or cells\n");
+	printf("\n");
+
 	printf(" --all          save all intermediate stages\n");
 	printf(" -o,--out       set the filename prefix for the saved intermediate stages\n\n");
 	printf(" -g,--graph     save the elaborated astg\n");
@@ -76,35 +87,168 @@ void build_help() {
 	printf(" *.astg         asynchronous signal transition graph\n");
 }
 
-int build_command(int argc, char **argv) {
-	parse_ucs::function::registry.insert({"func", parse_ucs::language(&parse_cog::produce, &parse_cog::expect, &parse_cog::register_syntax)});
-	parse_ucs::function::registry.insert({"proto", parse_ucs::language(&parse_cog::produce, &parse_cog::expect, &parse_cog::register_syntax)});
-	parse_ucs::function::registry.insert({"circ", parse_ucs::language(&parse_prs::produce, &parse_prs::expect, &parse_prs::register_syntax)});
+// Load the program, lower the requested terms and save the results.
+void runBuild(weaver::Project &proj, Build &builder, const vector<Proto> &protos) {
+	weaver::Program prgm;
+	loadGlobalTypes(prgm);
+
+	if (protos.empty()) {
+		proj.incl("top.wv");
+		proj.load(prgm);
+		builder.build(prgm);
+	} else {
+		for (auto i = protos.begin(); i != protos.end(); i++) {
+			proj.incl(i->path);
+		}
+		proj.load(prgm);
+		for (auto i = protos.begin(); i != protos.end(); i++) {
+			vector<weaver::TermId> curr = findProto(prgm, *i);
+			if (curr.empty()) {
+				error("", "module not found for term '" + i->to_string() + "'", __FILE__, __LINE__);
+			}
+			for (auto j = curr.begin(); j != curr.end(); j++) {
+				builder.build(prgm, *j);
+			}
+		}
+	}
+
+	if (builder.debug) {
+		prgm.print();
+	}
+
+	proj.save(prgm);
+}
+
+// The modification time of every layout in the cells directory
+map<fs::path, fs::file_time_type> stampLayouts(fs::path dir) {
+	map<fs::path, fs::file_time_type> result;
+	std::error_code ec;
+	if (dir.empty() or not fs::is_directory(dir, ec)) {
+		return result;
+	}
+	for (auto entry = fs::recursive_directory_iterator(dir, ec); not ec and entry != fs::recursive_directory_iterator(); entry.increment(ec)) {
+		if (entry->is_regular_file(ec) and entry->path().extension() == ".gds") {
+			result[fs::absolute(entry->path()).lexically_normal()] = entry->last_write_time(ec);
+		}
+	}
+	return result;
+}
+
+// Rebuild whenever a source, the cells or the techfile changes. Only the
+// modules of the changed sources and of the sources that include them are
+// lowered again. Everything else is parsed from the resident cache and its
+// outputs are left as they are from the previous build.
+int watchBuild(weaver::Project &proj, Build &builder, const vector<Proto> &protos) {
+	fs::path techPath;
+	fs::path cellsDir;
+	vector<fs::path> roots = proj.includePath;
+	if (not proj.tech.path.empty()) {
+		techPath = fs::absolute(extractPath(proj.tech.path)).lexically_normal();
+		roots.push_back(techPath.parent_path());
+	}
+	if (not proj.tech.lib.empty()) {
+		cellsDir = fs::absolute(proj.tech.lib).lexically_normal();
+		roots.push_back(cellsDir);
+	}
+
+	Watcher watcher;
+	if (not watcher.open(roots)) {
+		printf("error: unable to watch the sources for changes\n");
+		return 1;
+	}
+
+	printf("watching for changes...\n");
+	fflush(stdout);
+
+	// layouts the build itself wrote into the cells directory, and when
+	map<fs::path, fs::file_time_type> written;
+
+	std::set<fs::path> changed;
+	while (watcher.wait(changed)) {
+		bool everything = false;
+		std::set<fs::path> sources;
+		for (auto i = changed.begin(); i != changed.end(); i++) {
+			fs::path path = fs::absolute(*i).lexically_normal();
+			string rel = cellsDir.empty() ? "" : fs::relative(path, cellsDir).string();
+			if (not techPath.empty() and path == techPath) {
+				everything = true;
+				proj.tech = phy::Tech(proj.tech.path, proj.tech.lib);
+			} else if (not rel.empty() and rel.rfind("..", 0) != 0) {
+				// the verified cell index lives here as well, so only count layouts
+				if (path.extension() != ".gds") {
+					continue;
+				}
+				std::error_code ec;
+				auto pos = written.find(path);
+				if (pos != written.end() and fs::exists(path, ec) and fs::last_write_time(path, ec) == pos->second) {
+					continue;
+				}
+				everything = true;
+			} else if (path.has_extension() and proj.getExtension(path.extension().string().substr(1)) != nullptr) {
+				sources.insert(path);
+			}
+		}
+		changed.clear();
 
-	weaver::Term::pushDialect("func", factoryCog);
-	weaver::Term::pushDialect("proto", factoryCogw);
-	weaver::Term::pushDialect("circ", factoryPrs);
+		if (not everything and sources.empty()) {
+			continue;
+		}
+
+		builder.only.clear();
+		if (not everything) {
+			std::set<fs::path> affected = proj.dependents(sources);
+			for (auto i = affected.begin(); i != affected.end(); i++) {
+				builder.only.insert(proj.pathToModule(*i));
+			}
+		}
+
+		proj.imports.clear();
+		proj.sources.clear();
+		proj.includedBy.clear();
+		proj.streamed.clear();
+
+		Timer tmr;
+		if (everything) {
+			printf("rebuilding everything...\n");
+		} else {
+			printf("rebuilding %d module(s)...\n", (int)builder.only.size());
+		}
+		fflush(stdout);
+		weaver::resetMessages();
+		map<fs::path, fs::file_time_type> before = stampLayouts(cellsDir);
+		runBuild(proj, builder, protos);
+		map<fs::path, fs::file_time_type> after = stampLayouts(cellsDir);
+		for (auto i = after.begin(); i != after.end(); i++) {
+			auto pos = before.find(i->first);
+			if (pos == before.end() or pos->second != i->second) {
+				written[i->first] = i->second;
+			}
+		}
+		printf("done\t%gs\n", tmr.since());
+		fflush(stdout);
+	}
+
+	return 0;
+}
+
+int build_command(int argc, char **argv) {
+	registerDialects();
 
 	weaver::Project proj;
 	if (proj.hasMod()) {
 		proj.readMod();
 	}
 
-	proj.pushFiletype("", "wv", "", readWv, loadWv);
-	proj.pushFiletype("func", "cog", "", readCog, loadCog);
-	proj.pushFiletype("proto", "cogw", "", readCog, loadCogw);
-	proj.pushFiletype("circ", "prs", "ckt", readPrs, loadPrs, writePrs);
-	proj.pushFiletype("spice", "spi", "spi", readSpice, loadSpice, writeSpice);
-	proj.pushFiletype("verilog", "v", "rtl", nullptr, nullptr, writeVerilog);
-	proj.pushFiletype("layout", "gds", "gds", nullptr, loadGds, writeGds);
-	proj.pushFiletype("func", "astg", "state", readAstg, loadAstg, writeAstg);
-	proj.pushFiletype("proto", "astgw", "state", readAstg, loadAstgw, writeAstgw);
+	registerFiletypes(proj);
 
 	vector<Proto> protos;
 
 	Build builder(proj);
 	
 	bool manualCells = false;
+	string profilePath;
+	Profile profile;
+	bool watch = false;
 	for (int i = 0; i < argc; i++) {
 		string arg = argv[i];
 
@@ -125,6 +269,15 @@ int build_command(int argc, char **argv) {
 
 		} else if (arg == "--progress" or arg == "-p") {
 			builder.progress = true;
+		} else if (arg == "--jobs" or arg == "-j") {
+			if (++i >= argc) {
+				printf("expected number of jobs.\n");
+				return 0;
+			}
+			builder.jobs = atoi(argv[i]);
+			if (builder.jobs <= 0) {
+				builder.jobs = ThreadPool::concurrency();
+			}
 		} else if (arg == "--tech" or arg == "-t") {
 			if (++i >= argc) {
 				printf("expected path to tech file.\n");
@@ -232,6 +385,19 @@ int build_command(int argc, char **argv) {
 			builder.noCells = true;
 		} else if (arg == "--no-ghosts") {
 			builder.noGhosts = true;
+		} else if (arg == "--no-cache") {
+			builder.noCache = true;
+		} else if (arg == "--stream") {
+			builder.stream = true;
+		} else if (arg == "--watch" or arg == "-w") {
+			watch = true;
+		} else if (arg == "--profile") {
+			if (++i >= argc) {
+				printf("expected output filename.\n");
+				return 0;
+			}
+			profilePath = argv[i];
+			builder.profile = &profile;
 		} else {
 			protos.push_back(parseProto(proj, arg));
 		}
@@ -239,9 +405,6 @@ int build_command(int argc, char **argv) {
 
 	Timer totalTime;
 
-	weaver::Program prgm;
-	loadGlobalTypes(prgm);
-
 	// Create debug dir if it does not already exist
 	std::filesystem::path debugDirPath = proj.rootDir / proj.BUILD / "dbg";
 	if (!std::filesystem::exists(debugDirPath)) {
@@ -252,31 +415,21 @@ int build_command(int argc, char **argv) {
 		}
 	}
 
-	if (protos.empty()) {
-		proj.incl("top.wv");
-		proj.load(prgm);
-		builder.build(prgm);
-	} else {
-		for (auto i = protos.begin(); i != protos.end(); i++) {
-			proj.incl(i->path);
-		}
-		proj.load(prgm);
-		for (auto i = protos.begin(); i != protos.end(); i++) {
-			vector<weaver::TermId> curr = findProto(prgm, *i);
-			if (curr.empty()) {
-				error("", "module not found for term '" + i->to_string() + "'", __FILE__, __LINE__);
-			}
-			for (auto j = curr.begin(); j != curr.end(); j++) {
-				builder.build(prgm, *j);
-			}
-		}
+	if (watch) {
+		// keep the parsed sources around between rebuilds
+		weaver::resident.enabled = true;
 	}
 
-	if (builder.debug) {
-		prgm.print();
+	proj.jobs = builder.jobs;
+	runBuild(proj, builder, protos);
+	if (not profilePath.empty()) {
+		profile.write(profilePath, totalTime.since(), builder.jobs);
 	}
 
-	proj.save(prgm);
+	if (watch) {
+		builder.profile = nullptr;
+		return watchBuild(proj, builder, protos);
+	}
 
 	if (!is_clean()) {
 		complete();
@@ -285,4 +438,3 @@ int build_command(int argc, char **argv) {
 
 	return 0;
 }
-
@@ -18,6 +18,7 @@
 #include "weaver/builder.h"
 #include "weaver/project.h"
 #include "weaver/cli.h"
+#include "weaver/pool.h"
 
 #include "format/dot.h"
 #include "format/cog.h"
@@ -27,6 +28,7 @@
 #include "format/prs.h"
 #include "format/wv.h"
 #include "format/astg.h"
+#include "format/filetypes.h"
 
 #include <sch/Netlist.h>
 #include <sch/Tapeout.h>
@@ -36,12 +38,20 @@
 #include <phy/Layout.h>
 #include <phy/Library.h>
 
+#include <set>
+#include <unordered_map>
+
 const bool debug = false;
 
 void compare_help() {
 	printf("Usage: lm compare [options] [<module|term>[=<module|term>...]...]\n");
 	printf("Verify that the two circuit files are the same.\n");
 
+	printf("\nOptions:\n");
+	printf(" -h,--help        display this help text\n");
+	printf(" -s,--structure   pair subckts that have different names by comparing their structure\n");
+	printf(" -j,--jobs <N>    canonicalize and compare subckts on N threads (0 uses every core)\n");
+
 	printf("\nSupported file formats:\n");
 	//printf(" *.chp                   communicating hardware processes\n");
 	//printf(" *.hse                   handshaking expansions\n");
@@ -55,72 +65,236 @@ struct Group {
 	vector<Proto> terms;
 };
 
-void compare(sch::Subckt &s0, sch::Subckt &s1) {
-	printf("\t%s = %s...[", s0.name.c_str(), s1.name.c_str());
-	fflush(stdout);
+void prepare(sch::Subckt &ckt) {
+	ckt.cleanDangling(true);
+	ckt.combineDevices();
+	ckt.canonicalize();
+}
+
+// Subckts with different signatures can't match, this narrows down the
+// candidates when matching by structure.
+string signature(const sch::Subckt &ckt) {
+	return std::to_string((int)ckt.isCell) + ":" + std::to_string(ckt.nets.size()) + ":" + std::to_string(ckt.mos.size()) + ":" + std::to_string(ckt.inst.size());
+}
+
+// One entry of the report. Either a message, or the comparison of two terms
+// whose subckts are paired up and compared on the thread pool. The report is
+// printed in order once every comparison has finished.
+struct Check {
+	Check(string text);
+	Check(weaver::Term *child, weaver::Term *parent);
+
+	string text;
+	weaver::Term *child;
+	weaver::Term *parent;
+
+	// netlists extracted from layouts
+	sch::Netlist ext0;
+	sch::Netlist ext1;
+	sch::Netlist *n0;
+	sch::Netlist *n1;
+
+	// for each subckt of n0, the subckt of n1 it is paired with or -1
+	vector<int> match;
+	// for each subckt of n0, the result of sch::Subckt::compare
+	vector<int> result;
+	// subckts of n1 that were paired by name
+	vector<bool> used;
+
+	void load();
+	void pairByStructure();
+	void print();
+};
+
+Check::Check(string text) : text(text) {
+	child = nullptr;
+	parent = nullptr;
+	n0 = nullptr;
+	n1 = nullptr;
+}
+
+Check::Check(weaver::Term *child, weaver::Term *parent) : child(child), parent(parent) {
+	n0 = nullptr;
+	n1 = nullptr;
+}
 
-	if (s0.compare(s1) == 0) {
-		printf("%sMATCH%s]\n", KGRN, KNRM);
+// Extract the netlists and pair the subckts by name
+void Check::load() {
+	if (child->dialect().name == "layout" and parent->dialect().name == "spice") {
+		extract(ext0, child->as<phy::Library>());
+		n0 = &ext0;
+		n1 = &parent->as<sch::Netlist>();
+	} else if (child->dialect().name == "spice" and parent->dialect().name == "child") {
+		extract(ext1, parent->as<phy::Library>());
+		n0 = &child->as<sch::Netlist>();
+		n1 = &ext1;
+	} else if (child->dialect().name == "spice" and parent->dialect().name == "spice") {
+		n0 = &child->as<sch::Netlist>();
+		n1 = &parent->as<sch::Netlist>();
 	} else {
-		printf("%sMISMATCH%s]\n", KRED, KNRM);
-		if (debug) {
-			s0.print();
-			s1.print();
+		return;
+	}
+
+	std::unordered_map<string, int> byName;
+	byName.reserve(n1->subckts.size());
+	for (int j = 0; j < (int)n1->subckts.size(); j++) {
+		// the first subckt with a given name wins, like the linear search did
+		byName.insert(pair<string, int>(n1->subckts[j].name, j));
+	}
+
+	match.resize(n0->subckts.size(), -1);
+	result.resize(n0->subckts.size(), -1);
+	used.resize(n1->subckts.size(), false);
+	for (int i = 0; i < (int)n0->subckts.size(); i++) {
+		auto pos = byName.find(n0->subckts[i].name);
+		if (pos != byName.end()) {
+			match[i] = pos->second;
+			used[pos->second] = true;
 		}
 	}
 }
 
-void compare(sch::Netlist &n0, sch::Netlist &n1) {
-	vector<bool> c0(n0.subckts.size(), false);
-	vector<bool> c1(n1.subckts.size(), false);
-	for (auto i = n0.subckts.begin(); i != n0.subckts.end(); i++) {
-		bool found = false;
-		for (auto j = n1.subckts.begin(); j != n1.subckts.end(); j++) {
-			if (i->name == j->name) {
-				if (not c0[i-n0.subckts.begin()]) {
-					i->cleanDangling(true);
-					i->combineDevices();
-					i->canonicalize();
-					c0[i-n0.subckts.begin()] = true;
-				}
-				if (not c1[j-n1.subckts.begin()]) {
-					j->cleanDangling(true);
-					j->combineDevices();
-					j->canonicalize();
-					c1[j-n1.subckts.begin()] = true;
-				}
+// Pair the remaining subckts of n0 with structurally identical subckts of n1.
+// Every subckt must have been canonicalized already.
+void Check::pairByStructure() {
+	std::unordered_map<string, vector<int> > bySignature;
+	for (int j = 0; j < (int)n1->subckts.size(); j++) {
+		if (not used[j]) {
+			bySignature[signature(n1->subckts[j])].push_back(j);
+		}
+	}
 
-				compare(*i, *j);
-				found = true;
+	for (int i = 0; i < (int)n0->subckts.size(); i++) {
+		if (match[i] >= 0) {
+			continue;
+		}
+
+		auto pos = bySignature.find(signature(n0->subckts[i]));
+		if (pos == bySignature.end()) {
+			continue;
+		}
+
+		vector<int> &candidates = pos->second;
+		for (int j = 0; j < (int)candidates.size(); j++) {
+			if (n0->subckts[i].compare(n1->subckts[candidates[j]]) == 0) {
+				match[i] = candidates[j];
+				result[i] = 0;
+				candidates.erase(candidates.begin()+j);
 				break;
 			}
 		}
-		if (not found) {
-			printf("\t%s...[%sNOT FOUND%s]\n", i->name.c_str(), KYEL, KNRM);
-		}
 	}
 }
 
-void compare(weaver::Program &prgm, weaver::Term &child, weaver::Term &parent) {
-	if (child.dialect().name == "layout" and parent.dialect().name == "spice") {
-		phy::Library &lib = child.as<phy::Library>();
-		sch::Netlist s0;
-		extract(s0, lib);
-
-		compare(s0, parent.as<sch::Netlist>());
-	} else if (child.dialect().name == "spice" and parent.dialect().name == "child") {
-		phy::Library &lib = parent.as<phy::Library>();
-		sch::Netlist s1;
-		extract(s1, lib);
-
-		compare(child.as<sch::Netlist>(), s1);
-	} else if (child.dialect().name == "spice" and parent.dialect().name == "spice") {
-		compare(child.as<sch::Netlist>(), parent.as<sch::Netlist>());
+void Check::print() {
+	printf("%s", text.c_str());
+	if (child == nullptr) {
+		return;
+	}
+
+	for (int i = 0; n0 != nullptr and i < (int)n0->subckts.size(); i++) {
+		sch::Subckt &s0 = n0->subckts[i];
+		if (match[i] < 0) {
+			printf("\t%s...[%sNOT FOUND%s]\n", s0.name.c_str(), KYEL, KNRM);
+			continue;
+		}
+
+		sch::Subckt &s1 = n1->subckts[match[i]];
+		printf("\t%s = %s...[", s0.name.c_str(), s1.name.c_str());
+		if (result[i] == 0) {
+			printf("%sMATCH%s]\n", KGRN, KNRM);
+		} else {
+			printf("%sMISMATCH%s]\n", KRED, KNRM);
+			if (debug) {
+				s0.print();
+				s1.print();
+			}
+		}
 	}
 	printf("done\n\n");
 }
 
-void verifyImpl(weaver::Program &prgm, weaver::TermId idx) {
+// Run every check on a pool of jobs threads. Each stage is independent across
+// checks and subckts, so the pool is drained between stages. If structure is
+// set, subckts that have no match by name are paired by structure.
+void runChecks(vector<Check> &checks, int jobs, bool structure) {
+	ThreadPool pool(jobs);
+	for (auto c = checks.begin(); c != checks.end(); c++) {
+		if (c->child != nullptr) {
+			pool.push([c]() {
+				c->load();
+			});
+		}
+	}
+	pool.wait();
+
+	// A term may take part in more than one check, canonicalize each of its
+	// subckts only once.
+	std::set<sch::Subckt*> subckts;
+	for (auto c = checks.begin(); c != checks.end(); c++) {
+		if (c->n0 == nullptr) {
+			continue;
+		}
+		for (int i = 0; i < (int)c->n0->subckts.size(); i++) {
+			if (c->match[i] >= 0 or structure) {
+				subckts.insert(&c->n0->subckts[i]);
+			}
+		}
+		for (int j = 0; j < (int)c->n1->subckts.size(); j++) {
+			if (c->used[j] or structure) {
+				subckts.insert(&c->n1->subckts[j]);
+			}
+		}
+	}
+	for (auto ckt = subckts.begin(); ckt != subckts.end(); ckt++) {
+		sch::Subckt *curr = *ckt;
+		pool.push([curr]() {
+			prepare(*curr);
+		});
+	}
+	pool.wait();
+
+	// Several checks may ask for the same pair of subckts, compare each pair
+	// once and hand the result to every check that asked for it.
+	typedef pair<sch::Subckt*, sch::Subckt*> Pair;
+	map<Pair, vector<pair<Check*, int> > > pairs;
+	for (auto c = checks.begin(); c != checks.end(); c++) {
+		if (c->n0 == nullptr) {
+			continue;
+		}
+		for (int i = 0; i < (int)c->n0->subckts.size(); i++) {
+			if (c->match[i] >= 0) {
+				pairs[Pair(&c->n0->subckts[i], &c->n1->subckts[c->match[i]])].push_back(pair<Check*, int>(&*c, i));
+			}
+		}
+	}
+	for (auto p = pairs.begin(); p != pairs.end(); p++) {
+		Pair ckts = p->first;
+		vector<pair<Check*, int> > *users = &p->second;
+		pool.push([ckts, users]() {
+			int result = ckts.first->compare(*ckts.second);
+			for (auto u = users->begin(); u != users->end(); u++) {
+				u->first->result[u->second] = result;
+			}
+		});
+	}
+	pool.wait();
+
+	// Pairing by structure compares the same subckts again, so it waits for
+	// the pairwise compares to finish.
+	if (structure) {
+		for (auto c = checks.begin(); c != checks.end(); c++) {
+			if (c->n0 != nullptr) {
+				pool.push([c]() {
+					c->pairByStructure();
+				});
+			}
+		}
+		pool.wait();
+	}
+}
+
+void verifyImpl(vector<Check> &checks, weaver::Program &prgm, weaver::TermId idx) {
 	weaver::Term &t0 = prgm.termAt(idx);
 	if (t0.impl.empty()) {
 		return;
@@ -128,80 +302,92 @@ void verifyImpl(weaver::Program &prgm, weaver::TermId idx) {
 
 	for (auto j = t0.impl.begin(); j != t0.impl.end(); j++) {
 		if (not j->defined()) {
-			printf("error: undefined implements relationship\n");
+			checks.push_back(Check("error: undefined implements relationship\n"));
 			continue;
 		}
 
-		compare(prgm, t0, prgm.termAt(*j));
+		checks.push_back(Check(&t0, &prgm.termAt(*j)));
+	}
+}
+
+typedef std::unordered_map<string, vector<int> > TermIndex;
+
+// Index the terms of a module by name. The index is built the first time the
+// module is used and kept in cache for the rest of the group.
+TermIndex &termsByName(map<int, TermIndex> &cache, weaver::Program &prgm, int modIdx) {
+	auto pos = cache.find(modIdx);
+	if (pos == cache.end()) {
+		pos = cache.insert(pair<int, TermIndex>(modIdx, TermIndex())).first;
+		for (int i = 0; i < (int)prgm.mods[modIdx].terms.size(); i++) {
+			pos->second[prgm.mods[modIdx].terms[i].decl.name].push_back(i);
+		}
 	}
+	return pos->second;
 }
 
-void verifyGroup(weaver::Program &prgm, Group group) {
+void verifyGroup(vector<Check> &checks, weaver::Program &prgm, Group group) {
 	if (group.terms.empty()) {
 		return;
 	} else if (group.terms.size() == 1u) {
-		printf("%s:\n", group.terms[0].to_string().c_str());
+		checks.push_back(Check(group.terms[0].to_string() + ":\n"));
 		vector<weaver::TermId> idx = findProto(prgm, group.terms[0]);
 		if (group.terms[0].isModule()) {
 			if (idx[0].mod >= 0) {
 				for (idx[0].index = 0; idx[0].index < (int)prgm.mods[idx[0].mod].terms.size(); idx[0].index++) {
-					verifyImpl(prgm, idx[0]);
+					verifyImpl(checks, prgm, idx[0]);
 				}
 			} else {
-				printf("error: module not found '%s'\n", group.terms[0].to_string().c_str());
+				checks.push_back(Check("error: module not found '" + group.terms[0].to_string() + "'\n"));
 			}
 		} else if (group.terms[0].isTerm()) {
 			for (auto j = idx.begin(); j != idx.end(); j++) {
 				if (j->defined()) {
-					verifyImpl(prgm, *j);
+					verifyImpl(checks, prgm, *j);
 				} else {
-					printf("error: term not found '%s'\n", group.terms[0].to_string().c_str());
+					checks.push_back(Check("error: term not found '" + group.terms[0].to_string() + "'\n"));
 				}
 			}
 		}
 		return;
 	}
 	
+	map<int, TermIndex> index;
 	vector<weaver::TermId> prev = findProto(prgm, group.terms[0]);
 	if (prev.empty() or prev[0].mod < 0) {
-		printf("error: term not found '%s'\n", group.terms[0].to_string().c_str());
+		checks.push_back(Check("error: term not found '" + group.terms[0].to_string() + "'\n"));
 	}
 	for (int i = 1; i < (int)group.terms.size(); i++) {
 		vector<weaver::TermId> curr = findProto(prgm, group.terms[i]);
 		if (curr.empty() or curr[0].mod < 0) {
-			printf("error: term not found '%s'\n", group.terms[i].to_string().c_str());
+			checks.push_back(Check("error: term not found '" + group.terms[i].to_string() + "'\n"));
 		}
-		printf("%s = %s:\n", group.terms[i-1].to_string().c_str(), group.terms[i].to_string().c_str());
+		checks.push_back(Check(group.terms[i-1].to_string() + " = " + group.terms[i].to_string() + ":\n"));
 		for (auto j = prev.begin(); j != prev.end(); j++) {
 			for (auto k = curr.begin(); k != curr.end(); k++) {
 				if (k->defined() and j->defined()) {
-					weaver::Term &t0 = prgm.termAt(*j);
-					weaver::Term &t1 = prgm.termAt(*k);
-					compare(prgm, t0, t1);
+					checks.push_back(Check(&prgm.termAt(*j), &prgm.termAt(*k)));
 				} else if (k->defined() and j->mod >= 0) {
 					weaver::Term &t1 = prgm.termAt(*k);
-					for (int t0i = 0; t0i < (int)prgm.mods[j->mod].terms.size(); t0i++) {
-						weaver::Term &t0 = prgm.termAt(weaver::TermId(j->mod, t0i));
-						if (t0.decl.name == t1.decl.name) {
-							compare(prgm, t0, t1);
-						}
+					vector<int> &t0s = termsByName(index, prgm, j->mod)[t1.decl.name];
+					for (auto t0i = t0s.begin(); t0i != t0s.end(); t0i++) {
+						checks.push_back(Check(&prgm.termAt(weaver::TermId(j->mod, *t0i)), &t1));
 					}
 				} else if (k->mod >= 0 and j->defined()) {
 					weaver::Term &t0 = prgm.termAt(*j);
-					for (int t1i = 0; t1i < (int)prgm.mods[k->mod].terms.size(); t1i++) {
-						weaver::Term &t1 = prgm.termAt(weaver::TermId(k->mod, t1i));
-						if (t0.decl.name == t1.decl.name) {
-							compare(prgm, t0, t1);
-						}
+					vector<int> &t1s = termsByName(index, prgm, k->mod)[t0.decl.name];
+					for (auto t1i = t1s.begin(); t1i != t1s.end(); t1i++) {
+						checks.push_back(Check(&t0, &prgm.termAt(weaver::TermId(k->mod, *t1i))));
 					}
 				} else if (k->mod >= 0 and j->mod >= 0) {
+					TermIndex &t1Index = termsByName(index, prgm, k->mod);
 					for (int t0i = 0; t0i < (int)prgm.mods[j->mod].terms.size(); t0i++) {
 						weaver::Term &t0 = prgm.termAt(weaver::TermId(j->mod, t0i));
-						for (int t1i = 0; t1i < (int)prgm.mods[k->mod].terms.size(); t1i++) {
-							weaver::Term &t1 = prgm.termAt(weaver::TermId(k->mod, t1i));
-							if (t0.decl.name == t1.decl.name) {
-								compare(prgm, t0, t1);
-							}
+						auto t1s = t1Index.find(t0.decl.name);
+						if (t1s == t1Index.end()) {
+							continue;
+						}
+						for (auto t1i = t1s->second.begin(); t1i != t1s->second.end(); t1i++) {
+							checks.push_back(Check(&t0, &prgm.termAt(weaver::TermId(k->mod, *t1i))));
 						}
 					}
 				}
@@ -213,33 +399,46 @@ void verifyGroup(weaver::Program &prgm, Group group) {
 }
 
 int compare_command(int argc, char **argv) {
-	parse_ucs::function::registry.insert({"func", parse_ucs::language(&parse_cog::produce, &parse_cog::expect, &parse_cog::register_syntax)});
-	parse_ucs::function::registry.insert({"proto", parse_ucs::language(&parse_cog::produce, &parse_cog::expect, &parse_cog::register_syntax)});
-	parse_ucs::function::registry.insert({"circ", parse_ucs::language(&parse_prs::produce, &parse_prs::expect, &parse_prs::register_syntax)});
-
-	weaver::Term::pushDialect("func", factoryCog);
-	weaver::Term::pushDialect("proto", factoryCogw);
-	weaver::Term::pushDialect("circ", factoryPrs);
+	registerDialects();
 
 	weaver::Project proj;
 	if (proj.hasMod()) {
 		proj.readMod();
 	}
 
-	proj.pushFiletype("", "wv", "", readWv, loadWv);
-	proj.pushFiletype("func", "cog", "", readCog, loadCog);
-	proj.pushFiletype("proto", "cogw", "", readCog, loadCogw);
-	proj.pushFiletype("circ", "prs", "ckt", readPrs, loadPrs, writePrs);
-	proj.pushFiletype("spice", "spi", "spi", readSpice, loadSpice, writeSpice);
-	proj.pushFiletype("verilog", "v", "rtl", nullptr, nullptr, writeVerilog);
-	proj.pushFiletype("layout", "gds", "gds", nullptr, loadGds, writeGds);
-	proj.pushFiletype("func", "astg", "state", readAstg, loadAstg, writeAstg);
-	proj.pushFiletype("proto", "astgw", "state", readAstg, loadAstgw, writeAstgw);
+	registerFiletypes(proj);
+	// LVS only needs the netlist of a layout, so extract each structure as it
+	// is read instead of holding the whole library
+	for (auto f = proj.filetypes.begin(); f != proj.filetypes.end(); f++) {
+		if (f->ext == "gds") {
+			f->load = loadGdsNetlist;
+		}
+	}
 
 	vector<Group> groups;
+	bool structure = false;
+	int jobs = 1;
 
 	for (int i = 0; i < argc; i++) {
 		string arg = argv[i];
+		if (arg == "--structure" or arg == "-s") {
+			structure = true;
+			continue;
+		} else if (arg == "--jobs" or arg == "-j") {
+			if (++i >= argc) {
+				printf("expected number of jobs.\n");
+				return 0;
+			}
+			jobs = atoi(argv[i]);
+			if (jobs <= 0) {
+				jobs = ThreadPool::concurrency();
+			}
+			continue;
+		} else if (arg == "-h" or arg == "--help") {
+			compare_help();
+			return 0;
+		}
+
 		groups.push_back(Group());
 
 		size_t eq = arg.rfind("=");
@@ -272,17 +471,24 @@ int compare_command(int argc, char **argv) {
 		}
 	}
 
+	proj.jobs = jobs;
 	proj.load(prgm);
 
+	vector<Check> checks;
 	if (groups.empty()) {
 		for (auto i = prgm.begin(); i != prgm.end(); i = prgm.next(i)) {
-			verifyImpl(prgm, i);
+			verifyImpl(checks, prgm, i);
 		}
 	} else {
 		for (auto i = groups.begin(); i != groups.end(); i++) {
-			verifyGroup(prgm, *i);
+			verifyGroup(checks, prgm, *i);
 		}
 	}
+
+	runChecks(checks, jobs, structure);
+	for (auto c = checks.begin(); c != checks.end(); c++) {
+		c->print();
+	}
 	
 	complete();
 	return is_clean();
@@ -16,9 +16,9 @@
 #include <interpret_chp/export.h>
 #include <interpret_hse/export.h>
 
-void readAstg(weaver::Project &proj, weaver::Source &source, string buffer) {
+void readAstg(weaver::Project &proj, weaver::Source &source, std::string_view buffer) {
 	parse_astg::register_syntax(*source.tokens);
-	source.tokens->insert(source.path.string(), buffer, nullptr);
+	source.tokens->insert(source.path.string(), string(buffer), nullptr);
 
 	source.tokens->increment(false);
 	source.tokens->expect<parse_astg::graph>();
@@ -2,7 +2,7 @@
 
 #include "../weaver/project.h"
 
-void readAstg(weaver::Project &proj, weaver::Source &source, string buffer);
+void readAstg(weaver::Project &proj, weaver::Source &source, std::string_view buffer);
 void loadAstg(weaver::Project &proj, weaver::Program &prgm, const weaver::Source &source);
 void loadAstgw(weaver::Project &proj, weaver::Program &prgm, const weaver::Source &source);
 void writeAstg(fs::path path, const weaver::Project &proj, const weaver::Program &prgm, int modIdx, int termIdx);
@@ -2,13 +2,130 @@
 
 #include <common/timer.h>
 #include <sch/Tapeout.h>
+#include <phy/Script.h>
 
 #include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <set>
+#include <cstdarg>
+#include <functional>
+#include <unistd.h>
+
+#include "../weaver/pool.h"
+#include "../weaver/hash.h"
 
 using namespace std::filesystem;
 
 namespace cell {
 
+// Serializes writes to the cell library. Cells may be generated by several
+// workers, or by several terms being lowered in parallel.
+static std::mutex libraryLock;
+
+// Print the progress message, or buffer it in log so that the report for a
+// cell generated on a worker thread comes out in one piece.
+static void report(string *log, const char *fmt, ...) {
+	char buffer[1024];
+	va_list args;
+	va_start(args, fmt);
+	vsnprintf(buffer, sizeof(buffer), fmt, args);
+	va_end(args);
+
+	if (log == nullptr) {
+		printf("%s", buffer);
+		fflush(stdout);
+	} else {
+		*log += buffer;
+	}
+}
+
+// Write the file under a temporary name and rename it into place, so that
+// import_cell, which reads without the lock, never sees a partial cell.
+static void replace_file(string path, std::function<void(string)> write) {
+	string tmp = path + "." + std::to_string((int)getpid()) + ".tmp";
+	write(tmp);
+	std::error_code ec;
+	filesystem::rename(tmp, path, ec);
+	if (ec) {
+		printf("error: unable to write '%s'\n", path.c_str());
+		filesystem::remove(tmp, ec);
+	}
+}
+
+static void save_cell(const phy::Library &lib, const sch::Netlist &lst, int idx) {
+	std::lock_guard<std::mutex> guard(libraryLock);
+	if (not filesystem::exists(lib.tech->lib)) {
+		filesystem::create_directory(lib.tech->lib);
+	}
+	string cellPath = lib.tech->lib + "/" + lib.macros[idx].name;
+	// the layout goes last since import_cell checks for it first
+	replace_file(cellPath+".lef", [&](string path) {
+		export_lef(path, lib.macros[idx]);
+	});
+	replace_file(cellPath+".spi", [&](string path) {
+		export_spi(path, *lib.tech, lst, lst.subckts[idx]);
+	});
+	replace_file(cellPath+".gds", [&](string path) {
+		export_layout(path, lib.macros[idx]);
+	});
+}
+
+// The cells directory keeps an index of the cells that have already passed
+// LVS, one "name signature hash" line per cell. The signature is the canonical
+// id of the cell's netlist and the hash covers the layout and the techfile,
+// so editing either one sends the cell back through verification.
+static const char *VERIFIED_INDEX = "verified.idx";
+static std::mutex verifiedLock;
+static map<string, std::set<string> > verified;
+
+static string verified_entry(const phy::Library &lib, const sch::Subckt &spiNet, string cellPath) {
+	Hasher hash;
+	if (not hash.addFile(cellPath)) {
+		return "";
+	}
+	// the tech path may carry arguments for the script after the file name
+	if (not hash.addFile(extractPath(lib.tech->path))) {
+		return "";
+	}
+	return spiNet.name + " " + sch::idToString(spiNet.id) + " " + hash.to_string();
+}
+
+// must be called with verifiedLock held
+static std::set<string> &verified_cells(const phy::Library &lib) {
+	auto result = verified.insert(pair<string, std::set<string> >(lib.tech->lib, std::set<string>()));
+	if (result.second) {
+		std::ifstream fin(lib.tech->lib + "/" + VERIFIED_INDEX);
+		string line;
+		while (std::getline(fin, line)) {
+			if (not line.empty()) {
+				result.first->second.insert(line);
+			}
+		}
+	}
+	return result.first->second;
+}
+
+static bool is_verified(const phy::Library &lib, string entry) {
+	if (entry.empty()) {
+		return false;
+	}
+	std::lock_guard<std::mutex> guard(verifiedLock);
+	std::set<string> &cells = verified_cells(lib);
+	return cells.find(entry) != cells.end();
+}
+
+static void set_verified(const phy::Library &lib, string entry) {
+	if (entry.empty()) {
+		return;
+	}
+	std::lock_guard<std::mutex> guard(verifiedLock);
+	if (verified_cells(lib).insert(entry).second) {
+		std::ofstream fout(lib.tech->lib + "/" + VERIFIED_INDEX, std::ios::app);
+		fout << entry << endl;
+	}
+}
+
 void export_cell(int index, const phy::Library &lib, const sch::Netlist &net) {
 	if (lib.macros[index].name.rfind("cell_", 0) == 0) {
 		string cellPath = lib.tech->lib + "/" + lib.macros[index].name;
@@ -32,16 +149,14 @@ void export_cells(const phy::Library &lib, const sch::Netlist &net) {
 }
 
 // returns whether the cell was imported
-bool import_cell(phy::Library &lib, sch::Netlist &lst, int idx, bool progress, bool debug) {
+bool import_cell(phy::Library &lib, sch::Netlist &lst, int idx, bool progress, bool debug, string *log) {
 	if (idx >= (int)lib.macros.size()) {
 		lib.macros.resize(idx+1, Layout(*lib.tech));
 	}
 	lib.macros[idx].name = lst.subckts[idx].name;
 	string cellPath = lib.tech->lib + "/" + lib.macros[idx].name+".gds";
 	if (progress) {
-		printf("  %s...", lib.macros[idx].name.c_str());
-		fflush(stdout);
-		printf("[");
+		report(log, "  %s...[", lib.macros[idx].name.c_str());
 	}
 
 	Timer tmr;
@@ -54,8 +169,16 @@ bool import_cell(phy::Library &lib, sch::Netlist &lst, int idx, bool progress, b
 	spiNet.canonicalize();
 
 	if (filesystem::exists(cellPath)) {
+		// only the progress path runs LVS, so only it needs the verified index
+		string entry = progress ? verified_entry(lib, spiNet, cellPath) : "";
 		bool imported = import_layout(lib.macros[idx], cellPath, lib.macros[idx].name);
-		if (progress) {
+		if (imported and is_verified(lib, entry)) {
+			if (progress) {
+				searchDelay = tmr.since();
+				report(log, "%sFOUND %d DBUNIT2 AREA%s]\t%gs\n", KGRN, lib.macros[idx].box.area(), KNRM, searchDelay);
+			}
+			return true;
+		} else if (progress) {
 			if (imported) {
 				lib.macros[idx].trace();
 				sch::Subckt gdsNet(true);
@@ -65,14 +188,15 @@ bool import_cell(phy::Library &lib, sch::Netlist &lst, int idx, bool progress, b
 				gdsNet.canonicalize();
 				searchDelay = tmr.since();
 				if (gdsNet.compare(spiNet) == 0) {
-					printf("%sFOUND %d DBUNIT2 AREA%s]\t%gs\n", KGRN, lib.macros[idx].box.area(), KNRM, searchDelay);
+					set_verified(lib, entry);
+					report(log, "%sFOUND %d DBUNIT2 AREA%s]\t%gs\n", KGRN, lib.macros[idx].box.area(), KNRM, searchDelay);
 				} else {
-					printf("%sFAILED LVS%s, ", KRED, KNRM);
+					report(log, "%sFAILED LVS%s, ", KRED, KNRM);
 					imported = false;
 				}
 			} else {
 				searchDelay = tmr.since();
-				printf("%sFAILED IMPORT%s, ", KRED, KNRM);
+				report(log, "%sFAILED IMPORT%s, ", KRED, KNRM);
 			}
 		}
 		if (imported) {
@@ -88,10 +212,10 @@ bool import_cell(phy::Library &lib, sch::Netlist &lst, int idx, bool progress, b
 	if (progress) {
 		if (result == 1) {
 			genDelay = tmr.since();
-			printf("%sFAILED PLACEMENT%s]\t(%gs %gs)\n", KRED, KNRM, searchDelay, genDelay);
+			report(log, "%sFAILED PLACEMENT%s]\t(%gs %gs)\n", KRED, KNRM, searchDelay, genDelay);
 		} else if (result == 2) {
 			genDelay = tmr.since();
-			printf("%sFAILED ROUTING%s]\t(%gs %gs)\n", KRED, KNRM, searchDelay, genDelay);
+			report(log, "%sFAILED ROUTING%s]\t(%gs %gs)\n", KRED, KNRM, searchDelay, genDelay);
 		} else {
 			sch::Subckt gdsNet(true);
 			extract(gdsNet, lib.macros[idx], true);
@@ -101,9 +225,9 @@ bool import_cell(phy::Library &lib, sch::Netlist &lst, int idx, bool progress, b
 
 			genDelay = tmr.since();
 			if (gdsNet.compare(spiNet) == 0) {
-				printf("%sGENERATED %d DBUNIT2 AREA%s]\t(%gs %gs)\n", KGRN, lib.macros[idx].box.area(), KNRM, searchDelay, genDelay);
+				report(log, "%sGENERATED %d DBUNIT2 AREA%s]\t(%gs %gs)\n", KGRN, lib.macros[idx].box.area(), KNRM, searchDelay, genDelay);
 			} else {
-				printf("%sFAILED LVS%s]\t(%gs %gs)\n", KRED, KNRM, searchDelay, genDelay);
+				report(log, "%sFAILED LVS%s]\t(%gs %gs)\n", KRED, KNRM, searchDelay, genDelay);
 				if (debug) {
 					gdsNet.print();
 					spiNet.print();
@@ -114,26 +238,52 @@ bool import_cell(phy::Library &lib, sch::Netlist &lst, int idx, bool progress, b
 	return false;
 }
 
-void update_library(phy::Library &lib, sch::Netlist &lst, gdstk::GdsWriter *stream, map<int, gdstk::Cell*> *cells, bool progress, bool debug) {
-	bool libFound = filesystem::exists(lib.tech->lib);
+// Load the layout of cell idx from the library, or generate it and save it
+// to the library if none matches. The progress report goes to log if it is
+// set and to stdout otherwise.
+static void update_cell(phy::Library &lib, sch::Netlist &lst, int idx, bool progress, bool debug, string *log=nullptr) {
+	if (not import_cell(lib, lst, idx, progress, debug, log)) {
+		// We generated a new cell, save this to the cell library
+		save_cell(lib, lst, idx);
+	}
+}
+
+void update_library(phy::Library &lib, sch::Netlist &lst, gdstk::GdsWriter *stream, map<int, gdstk::Cell*> *cells, bool progress, bool debug, int jobs) {
 	if (progress) {
 		printf("Load cell layouts:\n");
 	}
 
 	Timer tmr;
 	lib.macros.reserve(lst.subckts.size()+lib.macros.size());
+	if (jobs > 1) {
+		// Workers only touch their own macro, make sure none of them has to grow
+		// the library.
+		if (lib.macros.size() < lst.subckts.size()) {
+			lib.macros.resize(lst.subckts.size(), Layout(*lib.tech));
+		}
+
+		std::mutex printLock;
+		ThreadPool pool(jobs);
+		for (int i = 0; i < (int)lst.subckts.size(); i++) {
+			if (lst.subckts[i].isCell) {
+				pool.push([&lib, &lst, &printLock, i, progress, debug]() {
+					string log;
+					update_cell(lib, lst, i, progress, debug, &log);
+					if (progress) {
+						std::lock_guard<std::mutex> guard(printLock);
+						printf("%s", log.c_str());
+						fflush(stdout);
+					}
+				});
+			}
+		}
+		pool.wait();
+	}
+
 	for (int i = 0; i < (int)lst.subckts.size(); i++) {
 		if (lst.subckts[i].isCell) {
-			if (not import_cell(lib, lst, i, progress, debug)) {
-				// We generated a new cell, save this to the cell library
-				if (not libFound) {
-					filesystem::create_directory(lib.tech->lib);
-					libFound = true;
-				}
-				string cellPath = lib.tech->lib + "/" + lib.macros[i].name;
-				export_layout(cellPath+".gds", lib.macros[i]);
-				export_lef(cellPath+".lef", lib.macros[i]);
-				export_spi(cellPath+".spi", *lib.tech, lst, lst.subckts[i]);
+			if (jobs <= 1) {
+				update_cell(lib, lst, i, progress, debug);
 			}
 			if (stream != nullptr and cells != nullptr) {
 				export_layout(*stream, lib, i, *cells);
@@ -12,7 +12,7 @@ namespace cell {
 
 void export_cell(int index, const phy::Library &lib, const sch::Netlist &net);
 void export_cells(const phy::Library &lib, const sch::Netlist &net);
-bool import_cell(phy::Library &lib, sch::Netlist &lst, int idx, bool progress=false, bool debug=false);
-void update_library(phy::Library &lib, sch::Netlist &lst, gdstk::GdsWriter *stream=nullptr, map<int, gdstk::Cell*> *cells=nullptr, bool progress=false, bool debug=false);
+bool import_cell(phy::Library &lib, sch::Netlist &lst, int idx, bool progress=false, bool debug=false, string *log=nullptr);
+void update_library(phy::Library &lib, sch::Netlist &lst, gdstk::GdsWriter *stream=nullptr, map<int, gdstk::Cell*> *cells=nullptr, bool progress=false, bool debug=false, int jobs=1);
 
 }
@@ -14,11 +14,11 @@
 #include <interpret_chp/import.h>
 #include <interpret_hse/import.h>
 
-void readCog(weaver::Project &proj, weaver::Source &source, string buffer) {
+void readCog(weaver::Project &proj, weaver::Source &source, std::string_view buffer) {
 	source.tokens->register_token<parse::block_comment>(false);
 	source.tokens->register_token<parse::line_comment>(false);
 	parse_cog::register_syntax(*source.tokens);
-	source.tokens->insert(source.path.string(), buffer, nullptr);
+	source.tokens->insert(source.path.string(), string(buffer), nullptr);
 
 	source.tokens->increment(false);
 	parse_cog::expect(*source.tokens);
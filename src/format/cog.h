@@ -2,7 +2,7 @@
 
 #include "../weaver/project.h"
 
-void readCog(weaver::Project &proj, weaver::Source &source, string buffer);
+void readCog(weaver::Project &proj, weaver::Source &source, std::string_view buffer);
 void loadCog(weaver::Project &proj, weaver::Program &prgm, const weaver::Source &source);
 void loadCogw(weaver::Project &proj, weaver::Program &prgm, const weaver::Source &source);
 std::any factoryCog(string name, const parse::syntax *syntax, tokenizer *tokens);
@@ -0,0 +1,9 @@
+#pragma once
+
+#include "../weaver/project.h"
+
+// Register the parsers and term factories for each dialect. Only the first
+// call has an effect.
+void registerDialects();
+// Register every file format that lm reads or writes with the project.
+void registerFiletypes(weaver::Project &proj);
@@ -8,19 +8,33 @@
 #include <phy/Tech.h>
 #include <phy/Script.h>
 #include <phy/Library.h>
+#include <sch/Netlist.h>
+#include <sch/Tapeout.h>
 
 #include <interpret_phy/import.h>
 #include <interpret_phy/export.h>
 
+#include <fstream>
+#include <thread>
+#include <unistd.h>
+
+#include "../weaver/mapped.h"
+#include "gdsindex.h"
+
 void loadGds(weaver::Project &proj, weaver::Program &prgm, const weaver::Source &source) {
-	if (not proj.tech.isLoaded() and not phy::loadTech(proj.tech)) {
-		cout << "Unable to load techfile \'" + proj.tech.path + "\'." << endl;
+	if (not proj.loadTech()) {
 		return;
 	}
 
 	string name = source.path.stem().string();
 	phy::Library lib(proj.tech);
-	import_library(lib, source.path.string());
+	if (not visit_gds(proj.tech, source.path, [&lib](phy::Layout &layout) {
+		lib.macros.push_back(std::move(layout));
+	})) {
+		string pathstr = source.path.string();
+		printf("error: unable to read gds file '%s'\n", pathstr.c_str());
+		return;
+	}
 
 	int kind = weaver::Term::getDialect("layout");
 	int modIdx = prgm.getModule(source.modName);
@@ -35,3 +49,73 @@ void writeGds(fs::path path, const weaver::Project &proj, const weaver::Program
 	const phy::Library &lib = prgm.mods[modIdx].terms[termIdx].as<phy::Library>();
 	phy::export_library(name, path.string(), lib);
 }
+
+bool visit_gds(const phy::Tech &tech, fs::path path, std::function<void(phy::Layout &)> visit, const std::set<string> &cells) {
+	MappedFile file;
+	if (not file.open(path)) {
+		return false;
+	}
+
+	GdsIndex index;
+	if (not index.scan(file.view())) {
+		return false;
+	}
+
+	// sources may be loaded on several threads at once
+	size_t self = std::hash<std::thread::id>()(std::this_thread::get_id());
+	fs::path tmp = fs::temp_directory_path() / ("lm_" + std::to_string((int)getpid()) + "_" + std::to_string(self) + ".gds");
+	bool result = true;
+	for (int i = 0; i < (int)index.structs.size(); i++) {
+		if (not cells.empty() and cells.find(index.structs[i].name) == cells.end()) {
+			continue;
+		}
+
+		// Only split the structure out when the file holds more than it needs,
+		// the importer flattens its references either way.
+		fs::path from = path;
+		vector<int> order = index.closure(i);
+		if (order.size() < index.structs.size()) {
+			if (not index.write(file.view(), order, tmp)) {
+				result = false;
+				break;
+			}
+			from = tmp;
+		}
+
+		phy::Layout layout(tech);
+		layout.name = index.structs[i].name;
+		if (import_layout(layout, from.string(), layout.name)) {
+			visit(layout);
+		}
+	}
+
+	std::error_code ec;
+	fs::remove(tmp, ec);
+	return result;
+}
+
+void loadGdsNetlist(weaver::Project &proj, weaver::Program &prgm, const weaver::Source &source) {
+	if (not proj.loadTech()) {
+		return;
+	}
+
+	string name = source.path.stem().string();
+	sch::Netlist net;
+	if (not visit_gds(proj.tech, source.path, [&net](phy::Layout &layout) {
+		layout.trace();
+		net.subckts.push_back(sch::Subckt(true));
+		extract(net.subckts.back(), layout, true);
+		net.subckts.back().name = layout.name;
+	})) {
+		string pathstr = source.path.string();
+		printf("error: unable to read gds file '%s'\n", pathstr.c_str());
+		return;
+	}
+
+	int kind = weaver::Term::getDialect("spice");
+	int modIdx = prgm.getModule(source.modName);
+
+	int termIdx = prgm.mods[modIdx].createTerm(weaver::Term::procOf(kind, name, vector<weaver::Instance>()));
+
+	prgm.mods[modIdx].terms[termIdx].def = net;
+}
@@ -2,5 +2,23 @@
 
 #include "../weaver/project.h"
 
+#include <functional>
+#include <set>
+
+#include <phy/Layout.h>
+
+// The visited layouts are collected into a single Library since that is what
+// a layout term holds. lm compare uses loadGdsNetlist instead.
 void loadGds(weaver::Project &proj, weaver::Program &prgm, const weaver::Source &source);
 void writeGds(fs::path path, const weaver::Project &proj, const weaver::Program &prgm, int modIdx, int termIdx);
+
+// Import the structures of a GDS file one at a time, each into its own Layout
+// with the structures it references flattened in, and pass them to visit in
+// file order. Only the structures named in cells are imported, unless cells is
+// empty. Returns false if the file could not be read.
+bool visit_gds(const phy::Tech &tech, fs::path path, std::function<void(phy::Layout &)> visit, const std::set<string> &cells=std::set<string>());
+
+// Load a GDS file as the spice netlist extracted from it, one subckt per
+// structure. Each layout is dropped as soon as it has been extracted, so LVS
+// against a large library never holds more than one structure's polygons.
+void loadGdsNetlist(weaver::Project &proj, weaver::Program &prgm, const weaver::Source &source);
@@ -0,0 +1,102 @@
+#include "gdsindex.h"
+
+#include <fstream>
+
+namespace {
+
+// GDSII record types used to split a file into its structures
+enum {
+	GDS_ENDLIB = 0x04,
+	GDS_BGNSTR = 0x05,
+	GDS_STRNAME = 0x06,
+	GDS_ENDSTR = 0x07,
+	GDS_SNAME = 0x12,
+};
+
+string recordString(std::string_view data, size_t pos, size_t length) {
+	string result(data.substr(pos+4, length-4));
+	// strings are padded to an even length with nulls
+	while (not result.empty() and result.back() == '\0') {
+		result.pop_back();
+	}
+	return result;
+}
+
+}
+
+bool GdsIndex::scan(std::string_view data) {
+	header = 0;
+	structs.clear();
+	byName.clear();
+
+	size_t pos = 0;
+	bool inside = false;
+	while (pos + 4 <= data.size()) {
+		size_t length = ((size_t)(unsigned char)data[pos] << 8) | (size_t)(unsigned char)data[pos+1];
+		int type = (unsigned char)data[pos+2];
+		if (length < 4 or pos + length > data.size()) {
+			// some writers pad the end of the file with zeros
+			return length == 0 and not inside;
+		}
+
+		if (type == GDS_BGNSTR) {
+			if (structs.empty()) {
+				header = pos;
+			}
+			structs.push_back(Structure());
+			structs.back().begin = pos;
+			inside = true;
+		} else if (type == GDS_STRNAME and inside) {
+			structs.back().name = recordString(data, pos, length);
+		} else if (type == GDS_SNAME and inside) {
+			structs.back().refs.push_back(recordString(data, pos, length));
+		} else if (type == GDS_ENDSTR and inside) {
+			structs.back().end = pos + length;
+			byName[structs.back().name] = (int)structs.size()-1;
+			inside = false;
+		} else if (type == GDS_ENDLIB) {
+			if (structs.empty()) {
+				header = pos;
+			}
+			return not inside;
+		}
+		pos += length;
+	}
+	return not inside;
+}
+
+vector<int> GdsIndex::closure(int index) const {
+	vector<int> order;
+	vector<bool> seen(structs.size(), false);
+	vector<int> stack(1, index);
+	while (not stack.empty()) {
+		int curr = stack.back();
+		stack.pop_back();
+		if (seen[curr]) {
+			continue;
+		}
+		seen[curr] = true;
+		order.push_back(curr);
+		for (auto ref = structs[curr].refs.begin(); ref != structs[curr].refs.end(); ref++) {
+			auto pos = byName.find(*ref);
+			if (pos != byName.end()) {
+				stack.push_back(pos->second);
+			}
+		}
+	}
+	return order;
+}
+
+bool GdsIndex::write(std::string_view data, const vector<int> &order, std::filesystem::path path) const {
+	std::ofstream fout(path.string().c_str(), std::ios::binary | std::ios::out | std::ios::trunc);
+	if (not fout.is_open()) {
+		return false;
+	}
+	fout.write(data.data(), header);
+	for (auto i = order.begin(); i != order.end(); i++) {
+		fout.write(data.data() + structs[*i].begin, structs[*i].end - structs[*i].begin);
+	}
+	const char endlib[4] = {0x00, 0x04, GDS_ENDLIB, 0x00};
+	fout.write(endlib, 4);
+	return fout.good();
+}
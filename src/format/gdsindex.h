@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using std::string;
+using std::vector;
+using std::map;
+
+// The byte ranges of the structures in a GDS file, found by walking the
+// record headers without decoding any geometry.
+struct GdsIndex {
+	struct Structure {
+		string name;
+		size_t begin;
+		size_t end;
+		// names of the structures placed by SREF or AREF
+		vector<string> refs;
+	};
+
+	// everything before the first structure: HEADER, BGNLIB, LIBNAME, UNITS...
+	size_t header;
+	vector<Structure> structs;
+	map<string, int> byName;
+
+	bool scan(std::string_view data);
+	// The structure and every structure it references, each listed once and
+	// starting with index itself. References to missing structures are left
+	// out.
+	vector<int> closure(int index) const;
+	// Write a standalone GDS file holding these structures.
+	bool write(std::string_view data, const vector<int> &order, std::filesystem::path path) const;
+};
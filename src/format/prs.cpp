@@ -11,11 +11,14 @@
 #include <interpret_prs/import.h>
 #include <interpret_prs/export.h>
 
-void readPrs(weaver::Project &proj, weaver::Source &source, string buffer) {
+#include <functional>
+#include <set>
+
+void readPrs(weaver::Project &proj, weaver::Source &source, std::string_view buffer) {
 	source.tokens->register_token<parse::block_comment>(false);
 	source.tokens->register_token<parse::line_comment>(false);
 	parse_prs::register_syntax(*source.tokens);
-	source.tokens->insert(source.path, buffer, nullptr);
+	source.tokens->insert(source.path, string(buffer), nullptr);
 	
 	source.tokens->increment(false);
 	parse_prs::expect(*source.tokens);
@@ -60,3 +63,47 @@ std::any factoryPrs(string name, const parse::syntax *syntax, tokenizer *tokens)
 	}
 	return pr;
 }
+
+vector<LaneRule> laneRules(const prs::production_rule_set &pr) {
+	map<int, vector<int> > byDrain;
+	for (int i = 0; i < (int)pr.devs.size(); i++) {
+		byDrain[pr.devs[i].drain].push_back(i);
+	}
+
+	vector<LaneRule> rules;
+	for (int n = 0; n < (int)pr.nets.size(); n++) {
+		for (int value = 0; value < 2; value++) {
+			LaneRule rule{n, value, {}};
+			vector<int> path;
+			std::set<int> visited;
+			std::function<void(int)> walk = [&](int node) {
+				auto devs = byDrain.find(node);
+				if (devs == byDrain.end()) {
+					return;
+				}
+				visited.insert(node);
+				for (auto i = devs->second.begin(); i != devs->second.end(); i++) {
+					const prs::device &dev = pr.devs[*i];
+					if (dev.driver != value or dev.attr.weak or dev.gate < 0 or dev.gate >= (int)pr.nets.size()) {
+						continue;
+					}
+					// the device conducts when its gate is at its threshold
+					path.push_back((dev.gate<<1) | (dev.threshold == 0 ? 1 : 0));
+					if (dev.source >= 0 and dev.source < (int)pr.nets.size() and pr.nets[dev.source].driver == value) {
+						rule.terms.push_back(path);
+					} else if (byDrain.find(dev.source) != byDrain.end() and visited.find(dev.source) == visited.end()) {
+						walk(dev.source);
+					}
+					path.pop_back();
+				}
+				visited.erase(node);
+			};
+			walk(n);
+
+			if (not rule.terms.empty()) {
+				rules.push_back(rule);
+			}
+		}
+	}
+	return rules;
+}
@@ -1,9 +1,18 @@
 #pragma once
 
 #include "../weaver/project.h"
+#include "../weaver/lanes.h"
 
-void readPrs(weaver::Project &proj, weaver::Source &source, string buffer);
+#include <prs/production_rule.h>
+
+void readPrs(weaver::Project &proj, weaver::Source &source, std::string_view buffer);
 void loadPrs(weaver::Project &proj, weaver::Program &prgm, const weaver::Source &source);
 void writePrs(fs::path path, const weaver::Project &proj, const weaver::Program &prgm, int modIdx, int termIdx);
 std::any factoryPrs(string name, const parse::syntax *syntax, tokenizer *tokens);
 
+// Flatten the transistor networks of pr into guards, one term per path of
+// strong devices from a net to the supply that drives it to the rule's value.
+// Paths that end anywhere else don't drive the net and are dropped. Weak
+// devices like keepers are left out since LaneSim has no notion of drive
+// strength.
+vector<LaneRule> laneRules(const prs::production_rule_set &pr);
@@ -13,14 +13,13 @@
 #include <interpret_sch/import.h>
 #include <interpret_sch/export.h>
 
-void readSpice(weaver::Project &proj, weaver::Source &source, string buffer) {
-	if (not proj.tech.isLoaded() and not phy::loadTech(proj.tech)) {
-		cout << "Unable to load techfile \'" + proj.tech.path + "\'." << endl;
+void readSpice(weaver::Project &proj, weaver::Source &source, std::string_view buffer) {
+	if (not proj.loadTech()) {
 		return;
 	}
 
 	parse_spice::register_syntax(*source.tokens);
-	source.tokens->insert(source.path.string(), buffer, nullptr);
+	source.tokens->insert(source.path.string(), string(buffer), nullptr);
 
 	source.tokens->increment(false);
 	parse_spice::expect(*source.tokens);
@@ -5,6 +5,7 @@
 #include <cinttypes>
 
 vcd::vcd() {
+	packed = false;
 	fvcd = nullptr;
 	fgtk = nullptr;
 	t = 0;
@@ -18,11 +19,57 @@ string &vcd::at(int net) {
 	return nets[net];
 }
 
+// Identifiers are three printable characters, counted up in base 94
+static void nextId(string &id) {
+	id[2] += 1;
+	if (id[2] > 126) {
+		id[1] += 1;
+		id[2] = 33;
+	}
+	if (id[1] > 126) {
+		id[0] += 1;
+		id[1] = 33;
+	}
+}
+
+// Replace the characters that waveform viewers treat as hierarchy
+static string signalName(string name) {
+	for (int j = (int)name.size(); j >= 0; j--) {
+		if (string(":.").find(name[j]) != string::npos) {
+			name[j] = '_';
+		} else if (string("[]").find(name[j]) != string::npos) {
+			name.erase(name.begin()+j);
+		}
+	}
+	return name;
+}
+
 void vcd::create(string prefix, ucs::ConstNetlist v) {
+	vector<string> names;
+	for (int i = 0; i < v.netCount(); i++) {
+		names.push_back(signalName(v.netAt(i)));
+	}
+	createWires(prefix, names);
+	gtkw(prefix, ".vcd");
+}
+
+void vcd::createWires(string prefix, const vector<string> &names) {
 	time_t rawtime;
 	tm *timeinfo;
 	char buffer[1024];
 
+	if ((int)names.size() > (int)nets.size()) {
+		nets.resize(names.size());
+	} 
+
+	if (packed) {
+		for (int i = 0; i < (int)names.size(); i++) {
+			curr.set(i, -1);
+		}
+		wave.create(prefix+".lmw", names);
+		return;
+	}
+
 	time (&rawtime);
 	timeinfo = localtime(&rawtime);
 	strftime(buffer,sizeof(buffer),"%Y-%m-%d",timeinfo);
@@ -33,34 +80,12 @@ void vcd::create(string prefix, ucs::ConstNetlist v) {
 	fprintf(fvcd, "$end\n");
 	fprintf(fvcd, "$timescale 1ps $end\n");
 
-	if ((int)v.netCount() > (int)nets.size()) {
-		nets.resize(v.netCount());
-	} 
 	string id = {33,33,33};
-	for (int i = 0; i < v.netCount(); i++) {
-		string name = v.netAt(i);
+	for (int i = 0; i < (int)names.size(); i++) {
 		at(i) = id;
 		curr.set(i, -1);
-
-		for (int j = (int)name.size(); j >= 0; j--) {
-			if (string(":.").find(name[j]) != string::npos) {
-				name[j] = '_';
-			} else if (string("[]").find(name[j]) != string::npos) {
-				name.erase(name.begin()+j);
-			}
-		}
-	
-		fprintf(fvcd, "$var wire %d %s %s $end\n", 1, id.c_str(), name.c_str());
-
-		id[2] += 1;
-		if (id[2] > 126) {
-			id[1] += 1;
-			id[2] = 33;
-		}
-		if (id[1] > 126) {
-			id[0] += 1;
-			id[1] = 33;
-		}
+		fprintf(fvcd, "$var wire %d %s %s $end\n", 1, id.c_str(), names[i].c_str());
+		nextId(id);
 	}
 
 	fprintf(fvcd, "$enddefinitions $end\n");
@@ -74,29 +99,52 @@ void vcd::create(string prefix, ucs::ConstNetlist v) {
 		//}
 	}
 	fprintf(fvcd, "$end\n");
+}
 
+void vcd::gtkw(string prefix, string ext) {
+	char buffer[1024];
 	getcwd(buffer, 1024);
 
 	fgtk = fopen((prefix+".gtkw").c_str(), "w");
-	fprintf(fgtk, "[dumpfile] \"%s/%s.vcd\"\n", buffer, prefix.c_str());
+	fprintf(fgtk, "[dumpfile] \"%s/%s%s\"\n", buffer, prefix.c_str(), ext.c_str());
 	fprintf(fgtk, "[savefile] \"%s/%s.gtkw\"\n", buffer, prefix.c_str());
 }
 
 
+// Packed cubes hold 16 nets per word, two bits each. Only the nets in words
+// that differ from the last event are decoded.
+static const int NETS_PER_WORD = 16;
+
 void vcd::append(uint64_t t, boolean::cube encoding, string error) {
 	static const char values[4] = {'x','0','1','z'};
-	if (t > this->t) {
-		fprintf(fvcd, "#%" PRIu64 "\n", t);
-		this->t = t;
-	}
+	stamp(t);
 
+	int n = (int)nets.size();
 	int m = (int)max(curr.values.size(), encoding.values.size());
-	for (int i = 0; i < m*16; i++) {
-		int value = encoding.get(i);
-		if (value != curr.get(i) and i < (int)nets.size()) {
-			fprintf(fvcd, "%c%s\n", values[value+1], nets[i].c_str());
+	for (int w = 0; w < m and w*NETS_PER_WORD < n; w++) {
+		uint64_t diff = ~(uint64_t)0;
+		if (w < (int)curr.values.size() and w < (int)encoding.values.size()) {
+			diff = (uint64_t)(curr.values[w] ^ encoding.values[w]);
+			if (diff == 0) {
+				continue;
+			}
+		}
+
+		for (int j = 0; j < NETS_PER_WORD; j++) {
+			int i = w*NETS_PER_WORD + j;
+			if (i >= n) {
+				break;
+			}
+			if (((diff >> (2*j)) & 3) == 0) {
+				continue;
+			}
+			int value = encoding.get(i);
+			if (value != curr.get(i)) {
+				change(values[value+1], i);
+			}
 		}
 	}
+	curr = encoding;
 
 	if (not error.empty()) {
 		markers.push_back(pair<uint64_t, string>(t, error));
@@ -105,30 +153,125 @@ void vcd::append(uint64_t t, boolean::cube encoding, string error) {
 
 void vcd::append(uint64_t t, boolean::cube encoding, boolean::cube strength, string error) {
 	static const char values[4] = {'x','0','1','z'};
-	if (t > this->t) {
-		fprintf(fvcd, "#%" PRIu64 "\n", t);
-		this->t = t;
-	}
+	stamp(t);
 
-	int m = (int)max(curr.values.size(), encoding.values.size());
-	for (int i = 0; i < m*16; i++) {
-		int value = encoding.get(i);
-		int drive = 2-strength.get(i);
-		if (drive == 0) {
-			value = 2;
+	int n = (int)nets.size();
+	int m = (int)max(max(curr.values.size(), encoding.values.size()), max(currStrength.values.size(), strength.values.size()));
+	for (int w = 0; w < m and w*NETS_PER_WORD < n; w++) {
+		uint64_t diff = ~(uint64_t)0;
+		if (w < (int)curr.values.size() and w < (int)encoding.values.size()
+			and w < (int)currStrength.values.size() and w < (int)strength.values.size()) {
+			diff = (uint64_t)((curr.values[w] ^ encoding.values[w]) | (currStrength.values[w] ^ strength.values[w]));
+			if (diff == 0) {
+				continue;
+			}
 		}
-		if (value != curr.get(i)) {
-			fprintf(fvcd, "%c%s\n", values[value+1], nets[i].c_str());
+
+		for (int j = 0; j < NETS_PER_WORD; j++) {
+			int i = w*NETS_PER_WORD + j;
+			if (i >= n) {
+				break;
+			}
+			if (((diff >> (2*j)) & 3) == 0) {
+				continue;
+			}
+
+			int prev = curr.get(i);
+			if (w < (int)currStrength.values.size() and 2-currStrength.get(i) == 0) {
+				prev = 2;
+			}
+			int value = encoding.get(i);
+			if (2-strength.get(i) == 0) {
+				value = 2;
+			}
+			if (value != prev) {
+				change(values[value+1], i);
+			}
 		}
 	}
+	curr = encoding;
+	currStrength = strength;
 
 	if (not error.empty()) {
 		markers.push_back(pair<uint64_t, string>(t, error));
 	}
 }
 
+void vcd::stamp(uint64_t t) {
+	if (packed) {
+		wave.stamp(t);
+		this->t = max(this->t, t);
+		return;
+	}
+	if (t > this->t) {
+		char buffer[24];
+		int length = snprintf(buffer, sizeof(buffer), "#%" PRIu64 "\n", t);
+		out.append(buffer, length);
+		this->t = t;
+	}
+}
+
+void vcd::change(char value, int net) {
+	if (packed) {
+		wave.change(value, net);
+		return;
+	}
+	out.push_back(value);
+	out.append(nets[net]);
+	out.push_back('\n');
+	if (out.size() >= (1u<<20)) {
+		flush();
+	}
+}
+
+void vcd::flush() {
+	if (fvcd != nullptr and not out.empty()) {
+		fwrite(out.data(), 1, out.size(), fvcd);
+	}
+	out.clear();
+}
+
+void vcd::createEvents(string prefix, const vector<string> &events) {
+	time_t rawtime;
+	tm *timeinfo;
+	char buffer[1024];
+
+	nets.assign(events.size(), "");
+	if (packed) {
+		wave.create(prefix+".lmw", events);
+		gtkw(prefix, ".vcd");
+		return;
+	}
+
+	time (&rawtime);
+	timeinfo = localtime(&rawtime);
+	strftime(buffer,sizeof(buffer),"%Y-%m-%d",timeinfo);
+
+	fvcd = fopen((prefix+".vcd").c_str(), "w");
+	fprintf(fvcd, "$date\n");
+	fprintf(fvcd, "%s\n", buffer);
+	fprintf(fvcd, "$end\n");
+	fprintf(fvcd, "$timescale 1ps $end\n");
+
+	string id = {33,33,33};
+	for (int i = 0; i < (int)events.size(); i++) {
+		nets[i] = id;
+		fprintf(fvcd, "$var event 1 %s %s $end\n", id.c_str(), events[i].c_str());
+		nextId(id);
+	}
+	fprintf(fvcd, "$enddefinitions $end\n");
+
+	gtkw(prefix, ".vcd");
+}
+
+void vcd::trigger(uint64_t t, int event) {
+	stamp(t);
+	change('1', event);
+}
 
 void vcd::close() {
+	flush();
+	wave.close();
 	if (fvcd != nullptr) {
 		fclose(fvcd);
 		fvcd = nullptr;
@@ -4,23 +4,48 @@
 #include <common/net.h>
 #include <boolean/cube.h>
 
+#include "wave.h"
+
 struct vcd {
 	vcd();
 	~vcd();
 
+	// write a block-indexed .lmw (see wave.h) instead of a text .vcd, the
+	// .gtkw still names the .vcd that "lm wave" converts it to
+	bool packed;
+	WaveWriter wave;
+
 	FILE *fvcd;
 	FILE *fgtk;
 	vector<string> nets;
 	vector<pair<uint64_t, string> > markers;
 	uint64_t t;
 
+	// the last values written, compared word by word against each new event
 	boolean::cube curr;
+	boolean::cube currStrength;
+
+	// Value changes are collected here and written out in large blocks
+	// instead of with one fprintf per net.
+	string out;
 
 	string &at(int net);
 
 	void create(string prefix, ucs::ConstNetlist nets);
+	// Declare one wire per name, without the .gtkw that create writes
+	void createWires(string prefix, const vector<string> &names);
 	void append(uint64_t t, boolean::cube encoding, string error="");
 	void append(uint64_t t, boolean::cube encoding, boolean::cube strength, string error="");
+
+	// Declare one event variable per name instead of the wires of a netlist,
+	// used to record when each transition fires.
+	void createEvents(string prefix, const vector<string> &events);
+	void trigger(uint64_t t, int event);
+
+	void gtkw(string prefix, string ext);
+	void stamp(uint64_t t);
+	void change(char value, int net);
+	void flush();
 	void close();
 };
 
@@ -0,0 +1,332 @@
+#include "wave.h"
+
+#include <cstring>
+
+#include <zlib.h>
+
+namespace {
+
+const char MAGIC[8] = {'L','M','W','A','V','E','2','\n'};
+const char INDEX[8] = {'L','M','W','I','N','D','E','X'};
+const char VALUES[4] = {'x','0','1','z'};
+
+int encode(char value) {
+	switch (value) {
+	case '0': return 1;
+	case '1': return 2;
+	case 'z': return 3;
+	default: return 0;
+	}
+}
+
+void putVarint(string &out, uint64_t value) {
+	while (value >= 0x80) {
+		out.push_back((char)((value & 0x7F) | 0x80));
+		value >>= 7;
+	}
+	out.push_back((char)value);
+}
+
+bool getVarint(const uint8_t *&ptr, const uint8_t *end, uint64_t &value) {
+	value = 0;
+	for (int shift = 0; ptr < end and shift < 64; shift += 7) {
+		uint8_t byte = *ptr++;
+		value |= (uint64_t)(byte & 0x7F) << shift;
+		if ((byte & 0x80) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool getVarint(FILE *fptr, uint64_t &value) {
+	value = 0;
+	for (int shift = 0; shift < 64; shift += 7) {
+		int byte = fgetc(fptr);
+		if (byte == EOF) {
+			return false;
+		}
+		value |= (uint64_t)(byte & 0x7F) << shift;
+		if ((byte & 0x80) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+}
+
+WaveWriter::WaveWriter() {
+	fptr = nullptr;
+	blockSize = 1u<<20;
+	blockStart = 0;
+	last = 0;
+	t = 0;
+	open = false;
+}
+
+WaveWriter::~WaveWriter() {
+	close();
+}
+
+bool WaveWriter::create(string path, const vector<string> &names) {
+	close();
+	fptr = fopen(path.c_str(), "wb");
+	if (fptr == nullptr) {
+		return false;
+	}
+
+	string header(MAGIC, sizeof(MAGIC));
+	putVarint(header, names.size());
+	for (auto name = names.begin(); name != names.end(); name++) {
+		putVarint(header, name->size());
+		header.append(*name);
+	}
+	fwrite(header.data(), 1, header.size(), fptr);
+
+	values.assign(names.size(), 0);
+	index.clear();
+	block.clear();
+	open = false;
+	t = 0;
+	last = 0;
+	return true;
+}
+
+void WaveWriter::stamp(uint64_t t) {
+	if (t > this->t) {
+		this->t = t;
+	}
+}
+
+void WaveWriter::change(char value, int net) {
+	if (fptr == nullptr or net < 0 or net >= (int)values.size()) {
+		return;
+	}
+
+	if (not open) {
+		// pack the state before this change, four signals per byte
+		snapshot.assign((values.size()+3)/4, 0);
+		for (int i = 0; i < (int)values.size(); i++) {
+			snapshot[i/4] |= (uint8_t)(values[i] << (2*(i%4)));
+		}
+		blockStart = t;
+		last = t;
+		block.clear();
+		open = true;
+	}
+
+	int code = encode(value);
+	bool advance = (t != last);
+	putVarint(block, ((uint64_t)net << 3) | ((uint64_t)code << 1) | (advance ? 1 : 0));
+	if (advance) {
+		putVarint(block, t - last);
+		last = t;
+	}
+	values[net] = (uint8_t)code;
+
+	if (block.size() >= blockSize) {
+		flush();
+	}
+}
+
+void WaveWriter::flush() {
+	if (fptr == nullptr or not open) {
+		return;
+	}
+
+	index.push_back(Block{blockStart, last, (uint64_t)ftello(fptr)});
+
+	string raw((const char *)snapshot.data(), snapshot.size());
+	raw.append(block);
+
+	// fall back to storing the block as is if zlib fails
+	uLongf size = compressBound(raw.size());
+	packed.resize(size);
+	bool compressed = compress2((Bytef *)packed.data(), &size, (const Bytef *)raw.data(), raw.size(), Z_BEST_SPEED) == Z_OK;
+	const string &data = compressed ? packed : raw;
+	if (compressed) {
+		packed.resize(size);
+	}
+
+	string header;
+	putVarint(header, blockStart);
+	putVarint(header, last);
+	putVarint(header, raw.size());
+	putVarint(header, ((uint64_t)data.size() << 1) | (compressed ? 1 : 0));
+	fwrite(header.data(), 1, header.size(), fptr);
+	fwrite(data.data(), 1, data.size(), fptr);
+
+	block.clear();
+	open = false;
+}
+
+void WaveWriter::close() {
+	if (fptr == nullptr) {
+		return;
+	}
+	flush();
+
+	uint64_t offset = (uint64_t)ftello(fptr);
+	string footer;
+	putVarint(footer, index.size());
+	for (auto i = index.begin(); i != index.end(); i++) {
+		putVarint(footer, i->start);
+		putVarint(footer, i->end);
+		putVarint(footer, i->offset);
+	}
+	for (int i = 0; i < 8; i++) {
+		footer.push_back((char)((offset >> (8*i)) & 0xFF));
+	}
+	footer.append(INDEX, sizeof(INDEX));
+	fwrite(footer.data(), 1, footer.size(), fptr);
+
+	fclose(fptr);
+	fptr = nullptr;
+	index.clear();
+}
+
+bool read_wave(string path, uint64_t from, uint64_t to, vector<string> &names, std::function<void(uint64_t, int, char)> change) {
+	FILE *fptr = fopen(path.c_str(), "rb");
+	if (fptr == nullptr) {
+		return false;
+	}
+
+	char magic[8];
+	uint64_t count = 0;
+	if (fread(magic, 1, 8, fptr) != 8 or memcmp(magic, MAGIC, 8) != 0 or not getVarint(fptr, count)) {
+		fclose(fptr);
+		return false;
+	}
+	names.clear();
+	for (uint64_t i = 0; i < count; i++) {
+		uint64_t length = 0;
+		if (not getVarint(fptr, length)) {
+			fclose(fptr);
+			return false;
+		}
+		string name(length, '\0');
+		if (fread(name.data(), 1, length, fptr) != length) {
+			fclose(fptr);
+			return false;
+		}
+		names.push_back(name);
+	}
+
+	uint8_t tail[16];
+	if (fseeko(fptr, -16, SEEK_END) != 0 or fread(tail, 1, 16, fptr) != 16 or memcmp(tail+8, INDEX, 8) != 0) {
+		fclose(fptr);
+		return false;
+	}
+	uint64_t offset = 0;
+	for (int i = 0; i < 8; i++) {
+		offset |= (uint64_t)tail[i] << (8*i);
+	}
+
+	vector<WaveWriter::Block> index;
+	uint64_t blocks = 0;
+	fseeko(fptr, (off_t)offset, SEEK_SET);
+	if (not getVarint(fptr, blocks)) {
+		fclose(fptr);
+		return false;
+	}
+	for (uint64_t i = 0; i < blocks; i++) {
+		WaveWriter::Block b;
+		if (not getVarint(fptr, b.start) or not getVarint(fptr, b.end) or not getVarint(fptr, b.offset)) {
+			fclose(fptr);
+			return false;
+		}
+		index.push_back(b);
+	}
+
+	// start from the last block that begins at or before from
+	size_t first = 0;
+	while (first+1 < index.size() and index[first+1].start <= from) {
+		first++;
+	}
+
+	vector<uint8_t> values(names.size(), 0);
+	bool reported = false;
+	auto report = [&]() {
+		for (int i = 0; i < (int)values.size(); i++) {
+			change(from, i, VALUES[values[i]]);
+		}
+		reported = true;
+	};
+
+	size_t snapshotSize = (names.size()+3)/4;
+	vector<uint8_t> stored;
+	vector<uint8_t> data;
+	for (size_t b = first; b < index.size() and index[b].start <= to; b++) {
+		uint64_t start = 0, end = 0, length = 0, packed = 0;
+		fseeko(fptr, (off_t)index[b].offset, SEEK_SET);
+		if (not getVarint(fptr, start) or not getVarint(fptr, end)
+			or not getVarint(fptr, length) or not getVarint(fptr, packed)
+			or length < snapshotSize) {
+			fclose(fptr);
+			return false;
+		}
+
+		stored.resize(packed >> 1);
+		if (fread(stored.data(), 1, stored.size(), fptr) != stored.size()) {
+			fclose(fptr);
+			return false;
+		}
+		if (packed & 1) {
+			data.resize(length);
+			uLongf size = length;
+			if (uncompress(data.data(), &size, stored.data(), stored.size()) != Z_OK or size != length) {
+				fclose(fptr);
+				return false;
+			}
+		} else if (stored.size() == length) {
+			data.swap(stored);
+		} else {
+			fclose(fptr);
+			return false;
+		}
+
+		if (b == first) {
+			for (int i = 0; i < (int)values.size(); i++) {
+				values[i] = (data[i/4] >> (2*(i%4))) & 3;
+			}
+		}
+
+		const uint8_t *ptr = data.data() + snapshotSize;
+		const uint8_t *stop = data.data() + data.size();
+		uint64_t t = start;
+		while (ptr < stop) {
+			uint64_t record = 0, delta = 0;
+			if (not getVarint(ptr, stop, record) or ((record & 1) and not getVarint(ptr, stop, delta))) {
+				fclose(fptr);
+				return false;
+			}
+			t += delta;
+			if (t > to) {
+				break;
+			}
+
+			int net = (int)(record >> 3);
+			uint8_t code = (uint8_t)((record >> 1) & 3);
+			if (net >= (int)values.size()) {
+				continue;
+			}
+			if (t < from) {
+				values[net] = code;
+				continue;
+			}
+			if (not reported) {
+				report();
+			}
+			values[net] = code;
+			change(t, net, VALUES[code]);
+		}
+	}
+
+	if (not reported) {
+		report();
+	}
+
+	fclose(fptr);
+	return true;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+// A compact, block-indexed binary waveform (.lmw). The file starts with the
+// names of the signals, followed by blocks of value changes. Each block
+// starts with the value of every signal, so it can be decoded without the
+// blocks before it. Times and signal ids are written as variable length
+// integers relative to the previous change, and each block is compressed
+// with zlib on its own. An index of the blocks by time is written at the end
+// of the file so a reader can seek without scanning.
+//
+// Values are the VCD characters 'x', '0', '1' and 'z'.
+struct WaveWriter {
+	WaveWriter();
+	~WaveWriter();
+
+	struct Block {
+		uint64_t start;
+		uint64_t end;
+		uint64_t offset;
+	};
+
+	FILE *fptr;
+	// the size of the encoded changes at which a block is closed
+	size_t blockSize;
+
+	vector<uint8_t> values;
+	vector<Block> index;
+
+	string block;
+	// the compressed block, kept to reuse its buffer
+	string packed;
+	vector<uint8_t> snapshot;
+	uint64_t blockStart;
+	uint64_t last;
+	uint64_t t;
+	bool open;
+
+	bool create(string path, const vector<string> &names);
+	void stamp(uint64_t t);
+	void change(char value, int net);
+	void flush();
+	void close();
+};
+
+// Read the signal names and the changes in [from, to] from a .lmw file. The
+// value of every signal at from is reported first, followed by each change
+// in order. Only the blocks that overlap the interval are decoded.
+bool read_wave(string path, uint64_t from, uint64_t to, vector<string> &names, std::function<void(uint64_t, int, char)> change);
@@ -9,11 +9,11 @@
 
 #include "../weaver/import.h"
 
-void readWv(weaver::Project &proj, weaver::Source &source, string buffer) {
+void readWv(weaver::Project &proj, weaver::Source &source, std::string_view buffer) {
 	source.tokens->register_token<parse::block_comment>(false);
 	source.tokens->register_token<parse::line_comment>(false);
 	parse_ucs::source::register_syntax(*source.tokens);
-	source.tokens->insert(source.path.string(), buffer, nullptr);
+	source.tokens->insert(source.path.string(), string(buffer), nullptr);
 
 	source.tokens->increment(true);
 	source.tokens->expect<parse_ucs::source>();
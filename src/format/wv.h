@@ -2,5 +2,5 @@
 
 #include "../weaver/project.h"
 
-void readWv(weaver::Project &proj, weaver::Source &source, string buffer);
+void readWv(weaver::Project &proj, weaver::Source &source, std::string_view buffer);
 void loadWv(weaver::Project &proj, weaver::Program &prgm, const weaver::Source &source);
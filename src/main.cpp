@@ -10,6 +10,8 @@
 #include "compare.h"
 #include "tech.h"
 #include "mod.h"
+#include "serve.h"
+#include "wave.h"
 
 #include <filesystem>
 #include <fstream>
@@ -28,9 +30,11 @@ void print_help() {
 	//printf("  test          verify the behavior/structure of the circuit\n");
 	printf("  compare       ensure that two circuit specifications match\n");
 	printf("  show          visualize the described circuit\n");
+	printf("  wave          convert a packed waveform to vcd\n");
 	printf("\n");
 	printf("  mod           manage this module\n");
 	printf("  tech          manage the technology node and cell libraries\n");
+	printf("  serve         keep the project loaded and run commands for other invocations\n");
 	printf("\n");
 	printf("  help          display this help text or more information about a command\n");
 	printf("  version       display version information\n");
@@ -45,12 +49,37 @@ void print_version() {
 	printf("\n");
 }
 
+// lm serve runs one request at a time, so commands that keep running until
+// they are interrupted would hold up every other invocation. Watch builds and
+// interactive simulations always run in this process.
+bool forwardable(int argc, char **argv) {
+	string cmd = argv[0];
+	bool batch = false;
+	for (int i = 1; i < argc; i++) {
+		string arg = argv[i];
+		if (cmd == "build" and (arg == "--watch" or arg == "-w")) {
+			return false;
+		} else if (arg == "--batch" or arg == "-b" or arg == "--seeds" or arg == "--vectors" or arg == "--explore") {
+			batch = true;
+		}
+	}
+	return cmd != "sim" or batch;
+}
+
 int main(int argc, char **argv) {
 	if (argc <= 1) {
 		print_help();
 		return 0;
 	}
 
+	string cmd = argv[1];
+	if (cmd == "build" or cmd == "sim" or cmd == "compare" or cmd == "show" or cmd == "unpack" or cmd == "tech") {
+		int code = 0;
+		if (forwardable(argc-1, argv+1) and serve_forward(argc-1, argv+1, code)) {
+			return code;
+		}
+	}
+
 	for (int i = 1; i < argc; i++) {
 		string arg = argv[i];
 		if (arg == "build") {
@@ -71,12 +100,18 @@ int main(int argc, char **argv) {
 		} else if (arg == "show") {
 			++i;
 			return show_command(argc-i, argv+i);
+		} else if (arg == "wave") {
+			++i;
+			return wave_command(argc-i, argv+i);
 		} else if (arg == "tech") {
 			++i;
 			return tech_command(argc-i, argv+i);
 		} else if (arg == "mod") {
 			++i;
 			return mod_command(argc-i, argv+i);
+		} else if (arg == "serve") {
+			++i;
+			return serve_command(argc-i, argv+i);
 		} else if (arg == "version") {
 			print_version();
 			return 0;
@@ -99,10 +134,14 @@ int main(int argc, char **argv) {
 				compare_help();
 			} else if (arg == "show") {
 				show_help();
+			} else if (arg == "wave") {
+				wave_help();
 			} else if (arg == "tech") {
 				tech_help();
 			} else if (arg == "mod") {
 				mod_help();
+			} else if (arg == "serve") {
+				serve_help();
 			} else {
 				printf("unrecognized command '%s'\n", argv[i]);
 				return 0;
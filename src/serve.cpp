@@ -0,0 +1,454 @@
+#include "serve.h"
+#include "build.h"
+#include "compare.h"
+#include "show.h"
+#include "sim.h"
+#include "tech.h"
+#include "unpack.h"
+
+#include <common/standard.h>
+#include <phy/Script.h>
+
+#include <cerrno>
+#include <cstring>
+#include <csignal>
+#include <filesystem>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "weaver/project.h"
+#include "weaver/watch.h"
+#include "format/filetypes.h"
+
+namespace fs = std::filesystem;
+
+// A request is sent as a 4 byte length carrying the client's stdin, stdout
+// and stderr as SCM_RIGHTS, followed by that many bytes holding the working
+// directory and the arguments, each terminated by a null. The server answers
+// with the 4 byte exit code of the command. If the connection closes without
+// an answer, the client runs the command itself.
+
+void serve_help() {
+	printf("Usage: lm serve [options]\n");
+	printf("Keep the project, techfile and parsed sources resident and run build, sim,\n");
+	printf("compare, show, unpack and tech requests from other invocations of lm.\n");
+	printf("\nOptions:\n");
+	printf(" -s,--socket <path>  listen on this socket instead of build/lm.sock\n");
+	printf("\nlm build, sim, compare, show, unpack and tech connect to $LM_SOCKET, or\n");
+	printf("build/lm.sock of the module, and fall back to running locally when no\n");
+	printf("server answers. The techfile is only evaluated again when its hash changes,\n");
+	printf("commands that run without a server evaluate it every time.\n");
+}
+
+#ifdef _WIN32
+
+int serve_command(int argc, char **argv) {
+	printf("error: lm serve requires unix domain sockets\n");
+	return 1;
+}
+
+bool serve_forward(int argc, char **argv, int &code) {
+	return false;
+}
+
+#else
+
+namespace {
+
+fs::path socketPath(const weaver::Project &proj) {
+	const char *env = std::getenv("LM_SOCKET");
+	if (env != nullptr) {
+		return fs::path(env);
+	}
+	return proj.rootDir / weaver::Project::BUILD / "lm.sock";
+}
+
+bool writeAll(int fd, const char *data, size_t size) {
+	while (size > 0) {
+		ssize_t n = write(fd, data, size);
+		if (n < 0 and errno == EINTR) {
+			continue;
+		} else if (n <= 0) {
+			return false;
+		}
+		data += n;
+		size -= n;
+	}
+	return true;
+}
+
+bool readAll(int fd, char *data, size_t size) {
+	while (size > 0) {
+		ssize_t n = read(fd, data, size);
+		if (n < 0 and errno == EINTR) {
+			continue;
+		} else if (n <= 0) {
+			return false;
+		}
+		data += n;
+		size -= n;
+	}
+	return true;
+}
+
+bool sendRequest(int sock, const string &payload) {
+	uint32_t length = (uint32_t)payload.size();
+	int fds[3] = {0, 1, 2};
+
+	struct iovec iov;
+	iov.iov_base = &length;
+	iov.iov_len = sizeof(length);
+
+	char control[CMSG_SPACE(sizeof(fds))];
+	memset(control, 0, sizeof(control));
+
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+	memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+	if (sendmsg(sock, &msg, 0) != (ssize_t)sizeof(length)) {
+		return false;
+	}
+	return writeAll(sock, payload.data(), payload.size());
+}
+
+// Receive a request, fds gets the client's stdin, stdout and stderr
+bool recvRequest(int sock, int fds[3], string &payload) {
+	uint32_t length = 0;
+	struct iovec iov;
+	iov.iov_base = &length;
+	iov.iov_len = sizeof(length);
+
+	char control[CMSG_SPACE(3*sizeof(int))];
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+
+	if (recvmsg(sock, &msg, 0) != (ssize_t)sizeof(length)) {
+		return false;
+	}
+
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	if (cmsg == nullptr or cmsg->cmsg_type != SCM_RIGHTS or cmsg->cmsg_len != CMSG_LEN(3*sizeof(int))) {
+		return false;
+	}
+	memcpy(fds, CMSG_DATA(cmsg), 3*sizeof(int));
+
+	payload.resize(length);
+	if (not readAll(sock, &payload[0], length)) {
+		for (int i = 0; i < 3; i++) {
+			close(fds[i]);
+		}
+		return false;
+	}
+	return true;
+}
+
+int run(vector<string> args) {
+	vector<char*> argv;
+	for (auto i = args.begin(); i != args.end(); i++) {
+		argv.push_back(&(*i)[0]);
+	}
+	argv.push_back(nullptr);
+
+	int argc = (int)args.size()-1;
+	string cmd = args[0];
+	if (cmd == "build") {
+		return build_command(argc, argv.data()+1);
+	} else if (cmd == "sim") {
+		return sim_command(argc, argv.data()+1);
+	} else if (cmd == "compare") {
+		return compare_command(argc, argv.data()+1);
+	} else if (cmd == "show") {
+		return show_command(argc, argv.data()+1);
+	} else if (cmd == "unpack") {
+		return unpack_command(argc, argv.data()+1);
+	} else if (cmd == "tech") {
+		return tech_command(argc, argv.data()+1);
+	}
+	printf("unrecognized command '%s'\n", cmd.c_str());
+	return 1;
+}
+
+// Parse one source into the resident cache. Files that haven't changed since
+// the last call are not parsed again.
+void warmFile(weaver::Project &proj, const fs::path &path) {
+	std::error_code ec;
+	if (not path.has_extension() or not fs::is_regular_file(path, ec)) {
+		return;
+	}
+	const weaver::Filetype *filetype = proj.getExtension(path.extension().string().substr(1));
+	if (filetype == nullptr or filetype->read == nullptr) {
+		return;
+	}
+
+	weaver::Program prgm;
+	proj.read(prgm, path);
+}
+
+void warmTech(weaver::Project &proj) {
+	if (not proj.tech.path.empty()) {
+		// start from an unloaded tech so that changes to the script are seen
+		proj.tech = phy::Tech(proj.tech.path, proj.tech.lib);
+		proj.loadTech();
+	}
+}
+
+// Parse every source of the project and load the techfile into the resident
+// cache.
+void warm(weaver::Project &proj) {
+	vector<fs::path> roots = proj.includePath;
+	for (auto root = roots.begin(); root != roots.end(); root++) {
+		std::error_code ec;
+		if (not fs::is_directory(*root, ec)) {
+			continue;
+		}
+
+		for (auto entry = fs::recursive_directory_iterator(*root, ec); not ec and entry != fs::recursive_directory_iterator(); entry.increment(ec)) {
+			warmFile(proj, entry->path());
+		}
+	}
+	proj.sources.clear();
+	proj.imports.clear();
+	warmTech(proj);
+}
+
+// Bring the resident cache up to date before a request by parsing only the
+// files the watcher saw change. Without a watcher every source is checked.
+void refresh(weaver::Project &proj, Watcher &watcher, bool watching, const fs::path &techPath) {
+	if (not watching) {
+		warm(proj);
+		return;
+	}
+
+	std::set<fs::path> changed;
+	if (not watcher.poll(changed)) {
+		return;
+	}
+
+	bool tech = false;
+	for (auto i = changed.begin(); i != changed.end(); i++) {
+		fs::path path = fs::absolute(*i).lexically_normal();
+		if (not techPath.empty() and path == techPath) {
+			tech = true;
+		} else {
+			warmFile(proj, path);
+		}
+	}
+	proj.sources.clear();
+	proj.imports.clear();
+	if (tech) {
+		warmTech(proj);
+	}
+}
+
+}
+
+int serve_command(int argc, char **argv) {
+	registerDialects();
+
+	weaver::Project proj;
+	if (proj.hasMod()) {
+		proj.readMod();
+	}
+
+	registerFiletypes(proj);
+
+	fs::path path = socketPath(proj);
+	for (int i = 0; i < argc; i++) {
+		string arg = argv[i];
+		if (arg == "-h" or arg == "--help") {
+			serve_help();
+			return 0;
+		} else if (arg == "--socket" or arg == "-s") {
+			if (++i >= argc) {
+				printf("expected socket path.\n");
+				return 1;
+			}
+			path = argv[i];
+		} else {
+			printf("unrecognized flag '%s'\n", arg.c_str());
+			return 1;
+		}
+	}
+
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	string pathstr = path.string();
+	if (pathstr.size() >= sizeof(addr.sun_path)) {
+		printf("error: socket path too long '%s'\n", pathstr.c_str());
+		return 1;
+	}
+	strncpy(addr.sun_path, pathstr.c_str(), sizeof(addr.sun_path)-1);
+
+	std::error_code ec;
+	fs::create_directories(path.parent_path(), ec);
+	fs::remove(path, ec);
+
+	int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listener < 0
+		or bind(listener, (struct sockaddr*)&addr, sizeof(addr)) != 0
+		or listen(listener, 16) != 0) {
+		printf("error: unable to listen on '%s': %s\n", pathstr.c_str(), strerror(errno));
+		return 1;
+	}
+	signal(SIGPIPE, SIG_IGN);
+
+	fs::path techPath;
+	vector<fs::path> roots = proj.includePath;
+	if (not proj.tech.path.empty()) {
+		techPath = fs::absolute(extractPath(proj.tech.path)).lexically_normal();
+		roots.push_back(techPath.parent_path());
+	}
+	Watcher watcher;
+	bool watching = watcher.open(roots);
+
+	weaver::resident.enabled = true;
+	weaver::resetMessages();
+	warm(proj);
+	printf("listening on %s\n", pathstr.c_str());
+	fflush(stdout);
+
+	while (true) {
+		int conn = accept(listener, nullptr, nullptr);
+		if (conn < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			break;
+		}
+
+		int fds[3];
+		string payload;
+		if (not recvRequest(conn, fds, payload)) {
+			close(conn);
+			continue;
+		}
+
+		// Errors from the files we parsed are counted by this process and
+		// would be inherited by every request, let the client report them.
+		// Sources with errors are never kept resident, so later requests parse
+		// them again in the child, which reports them to its client.
+		weaver::resetMessages();
+		refresh(proj, watcher, watching, techPath);
+		if (not is_clean()) {
+			for (int i = 0; i < 3; i++) {
+				close(fds[i]);
+			}
+			close(conn);
+			continue;
+		}
+
+		vector<string> args;
+		size_t start = 0;
+		for (size_t end = payload.find('\0'); end != string::npos; end = payload.find('\0', start)) {
+			args.push_back(payload.substr(start, end-start));
+			start = end+1;
+		}
+
+		// Run each request in a child so that it starts from the warm state of
+		// the server and leaves nothing behind.
+		fflush(stdout);
+		pid_t pid = args.size() >= 2 ? fork() : -1;
+		if (pid == 0) {
+			close(listener);
+			close(conn);
+			for (int i = 0; i < 3; i++) {
+				dup2(fds[i], i);
+				close(fds[i]);
+			}
+			int code = 1;
+			if (chdir(args[0].c_str()) == 0) {
+				code = run(vector<string>(args.begin()+1, args.end()));
+			} else {
+				printf("error: unable to enter '%s'\n", args[0].c_str());
+			}
+			fflush(stdout);
+			fflush(stderr);
+			_exit(code);
+		}
+
+		for (int i = 0; i < 3; i++) {
+			close(fds[i]);
+		}
+
+		int32_t code = 1;
+		int status = 0;
+		if (pid > 0 and waitpid(pid, &status, 0) == pid) {
+			code = WIFEXITED(status) ? WEXITSTATUS(status) : 128+WTERMSIG(status);
+		}
+		writeAll(conn, (const char*)&code, sizeof(code));
+		close(conn);
+	}
+
+	close(listener);
+	fs::remove(path, ec);
+	return 0;
+}
+
+bool serve_forward(int argc, char **argv, int &code) {
+	weaver::Project proj;
+	fs::path path = socketPath(proj);
+
+	std::error_code ec;
+	if (not fs::exists(path, ec)) {
+		return false;
+	}
+
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	string pathstr = path.string();
+	if (pathstr.size() >= sizeof(addr.sun_path)) {
+		return false;
+	}
+	strncpy(addr.sun_path, pathstr.c_str(), sizeof(addr.sun_path)-1);
+
+	int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (sock < 0) {
+		return false;
+	}
+	if (connect(sock, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+		close(sock);
+		return false;
+	}
+
+	string payload = fs::current_path().string();
+	payload.push_back('\0');
+	for (int i = 0; i < argc; i++) {
+		payload += argv[i];
+		payload.push_back('\0');
+	}
+
+	// stdout is shared with the server, don't let buffered output interleave
+	fflush(stdout);
+	fflush(stderr);
+
+	int32_t result = 0;
+	bool answered = sendRequest(sock, payload) and readAll(sock, (char*)&result, sizeof(result));
+	close(sock);
+	if (answered) {
+		code = result;
+	}
+	return answered;
+}
+
+#endif
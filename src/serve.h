@@ -0,0 +1,8 @@
+#pragma once
+
+void serve_help();
+int serve_command(int argc, char **argv);
+
+// Hand the command to a running lm serve. Returns false if there is no server
+// to take it, in which case the command should run in this process.
+bool serve_forward(int argc, char **argv, int &code);
@@ -1,6 +1,8 @@
 #include "sim.h"
 
 #include <cinttypes>
+#include <optional>
+#include <unistd.h>
 
 #include <common/standard.h>
 #include <parse/parse.h>
@@ -23,6 +25,11 @@
 
 #include "weaver/project.h"
 #include "weaver/cli.h"
+#include "weaver/events.h"
+#include "weaver/pool.h"
+#include "weaver/shards.h"
+#include "weaver/runs.h"
+#include "weaver/lanes.h"
 
 #include "format/dot.h"
 #include "format/cog.h"
@@ -32,6 +39,7 @@
 #include "format/prs.h"
 #include "format/wv.h"
 #include "format/astg.h"
+#include "format/filetypes.h"
 
 #include "format/vcd.h"
 
@@ -48,6 +56,28 @@ void sim_help() {
 	printf("Usage: lm sim [options] <ckt-file> [sim-file]\n");
 	printf("A simulation environment for various behavioral descriptions.\n");
 
+	printf("\nOptions:\n");
+	printf(" -b,--batch       run production rules without the interactive prompt or per-event output\n");
+	printf("    --source <file>  run these commands before the batch, like the source command\n");
+	printf("    --steps <N>      fire at most N transitions (default: until nothing is enabled)\n");
+	printf("    --until <time>   stop at the first transition after this time in ps\n");
+	printf("    --delay <spec>   chp only, the delay of each transition in ps (default: 100)\n");
+	printf("                     <t>, uniform:<lo>,<hi>, normal:<mean>,<sd> or exp:<mean>\n");
+	printf("    --delay T<i>=<spec>  override the delay of transition i\n");
+	printf("    --seed <n>       chp only, seed the delay distributions (default: 0)\n");
+	printf(" --seeds <A>..<B>  hse only, run one random simulation per seed and report the failures\n");
+	printf(" --explore        hse only, search every reachable state for interference, instability\n");
+	printf("                  and mutex violations, --steps limits the depth of the search\n");
+	printf("    --states <N>     keep at most N states in memory per level, replaying the rest (default: 100000)\n");
+	printf("    --spill <N>      keep at most N visited states in memory, moving the rest to disk\n");
+	printf(" --vectors <N>    prs only, simulate N random stimulus vectors at once with bit-parallel\n");
+	printf("                  evaluation, --steps sets the number of stimulus cycles (default: 100)\n");
+	printf("    --unit-delay     take one step per cycle instead of settling each cycle\n");
+	printf(" -j,--jobs <N>    run the seeds or the search on N threads (0 uses every core)\n");
+	printf("                  each seed stops after --steps transitions (default: 10000)\n");
+	printf(" --wave <fmt>     waveform format, 'vcd' (default) or 'lmw', a compact block-indexed binary\n");
+	printf("                  that \"lm wave\" converts to vcd\n");
+
 	printf("\nSupported file formats:\n");
 	printf(" *.cog           a wire-level programming language\n");
 	printf(" *.chp           a data-level process calculi called Communicating Hardware Processes\n");
@@ -131,9 +161,7 @@ void chpsim(chp::graph &g, vector<chp::term_index> steps = vector<chp::term_inde
 	tokenizer assignment_parser(false);
 	parse_expression::composition::register_syntax(assignment_parser);
 
-	// TODO(edward.bingham) use a minheap and random event times to implement a
-	// discrete event simulator here based upon the set of enabled signals.
-	//vector<pair<uint64_t, > > events;
+	// See chptime() for the discrete event simulation used by --batch
 
 	int seed = 0;
 	srand(seed);
@@ -473,7 +501,7 @@ void chpsim(chp::graph &g, vector<chp::term_index> steps = vector<chp::term_inde
 
 }
 
-void hsesim(hse::graph &g, vector<hse::term_index> steps = vector<hse::term_index>()) {
+void hsesim(hse::graph &g, vector<hse::term_index> steps = vector<hse::term_index>(), bool packed=false) {
 	hse::simulator sim;
 	sim.base = &g;
 
@@ -485,6 +513,7 @@ void hsesim(hse::graph &g, vector<hse::term_index> steps = vector<hse::term_inde
 	//vector<pair<uint64_t, > > events;
 
 	vcd dump;
+	dump.packed = packed;
 	dump.create(g.name, g);
 
 	int seed = 0;
@@ -809,11 +838,351 @@ void hsesim(hse::graph &g, vector<hse::term_index> steps = vector<hse::term_inde
 	dump.close();
 }
 
-void prsim(prs::production_rule_set &pr, bool debug) {//, vector<prs::term_index> steps = vector<prs::term_index>()) {
+// Options for lm sim --batch. The commands in the source file, if any, are
+// run without a prompt or per-event output. The simulation then fires up to
+// steps transitions, stopping at the first event after until. The delays
+// only apply to the timed chp simulation.
+struct Batch {
+	Batch();
+
+	bool enabled;
+	string source;
+	int64_t steps;
+	uint64_t until;
+
+	// write the waveform as .lmw instead of .vcd, this also applies
+	// to the interactive simulators
+	bool packed;
+
+	uint64_t seed;
+	Delay delay;
+	// per-transition overrides of delay
+	map<int, Delay> delays;
+
+	// --seeds runs a random hse simulation for every seed in this range on
+	// jobs threads, the range is empty if first > second
+	pair<uint64_t, uint64_t> seeds;
+	int jobs;
+
+	// --explore searches every reachable hse state instead, keeping at most
+	// states simulators in memory per level
+	bool explore;
+	int64_t states;
+	// visited states past this count are moved to disk, never if negative
+	int64_t spill;
+
+	// --vectors simulates this many random stimulus vectors of the production
+	// rules at once, settling each cycle unless unit is set
+	int vectors;
+	bool unit;
+};
+
+Batch::Batch() {
+	enabled = false;
+	steps = -1;
+	until = UINT64_MAX;
+	packed = false;
+	seed = 0;
+	delay = Delay(100.0);
+	seeds = pair<uint64_t, uint64_t>(1, 0);
+	jobs = 1;
+	explore = false;
+	states = 100000;
+	spill = -1;
+	vectors = 0;
+	unit = false;
+}
+
+// The outcome of one seed of a random simulation campaign
+struct SeedRun {
+	uint64_t seed;
+	int64_t fired;
+	// the errors raised by the last transition, empty if the run was clean
+	vector<string> failures;
+	// the transitions fired, dropped by hsecampaign for clean runs
+	vector<hse::term_index> trace;
+};
+
+// Fire up to steps transitions of g, choosing at random among the earliest
+// enabled transitions like the step command of hsesim. The run stops at the
+// first transition that causes an interference, instability or mutex error.
+SeedRun hserun(const hse::graph &base, uint64_t seed, int64_t steps) {
+	SeedRun run;
+	run.seed = seed;
+	run.fired = 0;
+
+	// every run gets its own copy of the graph and its own generator
+	hse::graph g = base;
+	std::mt19937_64 rng(seed);
+	hse::simulator sim(&g, g.reset[0]);
+	while (run.fired < steps) {
+		int enabled = sim.enabled();
+		if (enabled == 0) {
+			break;
+		}
+
+		vector<int> now;
+		for (int i = 0; i < (int)sim.ready.size(); i++) {
+			if (now.empty() or sim.loaded[sim.ready[i].first].fire_at < sim.loaded[sim.ready[now[0]].first].fire_at) {
+				now.clear();
+				now.push_back(i);
+			} else if (sim.loaded[sim.ready[i].first].fire_at == sim.loaded[sim.ready[now[0]].first].fire_at) {
+				now.push_back(i);
+			}
+		}
+		int firing = now[rng()%now.size()];
+
+		hse::term_index t(sim.loaded[sim.ready[firing].first].index, sim.ready[firing].second);
+		// the guard is gone once the transition fires, keep it for the report
+		boolean::cube guard = sim.loaded[sim.ready[firing].first].guard_action;
+		run.trace.push_back(t);
+
+		sim.fire(firing);
+		run.fired++;
+
+		if (not sim.interference_errors.empty() or not sim.instability_errors.empty() or not sim.mutex_errors.empty()) {
+			string desc = "T" + std::to_string(t.index) + "." + std::to_string(t.term) + " "
+				+ export_expression(guard, g).to_string() + " -> "
+				+ export_composition(g.transitions[t.index].local_action[t.term], g).to_string();
+			if (not sim.interference_errors.empty()) {
+				run.failures.push_back("interference at " + desc);
+			}
+			if (not sim.instability_errors.empty()) {
+				run.failures.push_back("instability at " + desc);
+			}
+			if (not sim.mutex_errors.empty()) {
+				run.failures.push_back("mutex violation at " + desc);
+			}
+			break;
+		}
+	}
+	return run;
+}
+
+// Run every seed in [batch.seeds.first, batch.seeds.second] on its own
+// simulator in parallel. Failures are grouped by the error and the
+// transition that caused it, and the lowest seed of each group has its
+// trace saved to a .sim file that replays it in hsesim.
+void hsecampaign(hse::graph &g, const Batch &batch) {
+	if (g.reset.empty()) {
+		printf("error: no reset state to start the simulation from\n");
+		return;
+	}
+
+	int64_t steps = batch.steps < 0 ? 10000 : batch.steps;
+	uint64_t count = batch.seeds.second - batch.seeds.first + 1;
+	vector<SeedRun> runs(count);
+	{
+		ThreadPool pool(batch.jobs);
+		for (uint64_t i = 0; i < count; i++) {
+			pool.push([&runs, &g, &batch, steps, i]() {
+				runs[i] = hserun(g, batch.seeds.first + i, steps);
+				// only the traces of failing seeds are saved
+				if (runs[i].failures.empty()) {
+					vector<hse::term_index>().swap(runs[i].trace);
+				}
+			});
+		}
+		pool.wait();
+	}
+
+	// runs are in seed order, so the first seed seen for a failure is the lowest
+	map<string, int> first;
+	map<string, int> hits;
+	int failed = 0;
+	for (int i = 0; i < (int)runs.size(); i++) {
+		if (not runs[i].failures.empty()) {
+			failed++;
+		}
+		for (auto f = runs[i].failures.begin(); f != runs[i].failures.end(); f++) {
+			first.insert(pair<string, int>(*f, i));
+			hits[*f]++;
+		}
+	}
+
+	for (auto f = first.begin(); f != first.end(); f++) {
+		const SeedRun &run = runs[f->second];
+		string path = g.name + "_seed" + std::to_string(run.seed) + ".sim";
+		FILE *seq = fopen(path.c_str(), "w");
+		if (seq != nullptr) {
+			for (int i = 0; i < (int)run.trace.size(); i++) {
+				fprintf(seq, "%d.%d\n", run.trace[i].index, run.trace[i].term);
+			}
+			fclose(seq);
+		}
+		printf("%s\n", f->first.c_str());
+		printf("\t%d seeds, first seed %" PRIu64 " after %" PRId64 " transitions, replay with %s\n", hits[f->first], run.seed, run.fired, path.c_str());
+	}
+	printf("%" PRIu64 " seeds, %d failed, %d distinct failures\n", count, failed, (int)first.size());
+}
+
+// Run the chp graph as a discrete event simulation. When a transition becomes
+// enabled, its firing is scheduled after a delay drawn from its distribution,
+// and that event is dropped if the transition is disabled before it fires.
+// Vacuous transitions fire immediately. Every firing is recorded as an event
+// in a VCD, and the firing times of each transition are summarized at the end.
+// Interference, instability and mutex errors don't stop the run, they are
+// counted per transition and marked in the .gtkw.
+void chptime(chp::graph &g, const Batch &batch) {
+	typedef std::pair<int, int> Key;
+
+	if (g.reset.empty()) {
+		printf("error: no reset state to start the simulation from\n");
+		return;
+	}
+
+	std::mt19937_64 rng(batch.seed);
+	chp::simulator sim(&g, g.reset[0]);
+
+	vector<string> names;
+	for (int i = 0; i < (int)g.transitions.size(); i++) {
+		names.push_back("T" + std::to_string(i));
+	}
+	vcd dump;
+	dump.packed = batch.packed;
+	dump.createEvents(g.name, names);
+
+	struct Stats {
+		int64_t count = 0;
+		// firings that raised an error
+		int64_t errors = 0;
+		uint64_t first = 0;
+		uint64_t last = 0;
+	};
+	vector<Stats> stats(g.transitions.size());
+	int64_t interference = 0;
+	int64_t instability = 0;
+	int64_t mutexes = 0;
+
+	EventQueue<Key> events;
+	uint64_t now = 0;
+	int64_t fired = 0;
+	while (batch.steps < 0 or fired < batch.steps) {
+		int enabled = sim.enabled();
+
+		std::map<Key, int> ready;
+		for (int i = 0; i < enabled; i++) {
+			ready.insert(std::pair<Key, int>(Key(sim.loaded[sim.ready[i].first].index, sim.ready[i].second), i));
+		}
+
+		vector<Key> stale;
+		for (auto i = events.pending.begin(); i != events.pending.end(); i++) {
+			if (ready.find(i->first) == ready.end()) {
+				stale.push_back(i->first);
+			}
+		}
+		for (auto i = stale.begin(); i != stale.end(); i++) {
+			events.cancel(*i);
+		}
+
+		for (auto i = ready.begin(); i != ready.end(); i++) {
+			if (events.has(i->first)) {
+				continue;
+			}
+			uint64_t delay = 0;
+			if (not sim.loaded[sim.ready[i->second].first].vacuous) {
+				auto d = batch.delays.find(i->first.first);
+				delay = (d != batch.delays.end() ? d->second : batch.delay).sample(rng);
+			}
+			events.schedule(i->first, now + delay);
+		}
+
+		Key key;
+		uint64_t at = 0;
+		if (not events.pop(key, at) or at > batch.until) {
+			break;
+		}
+		now = at;
+
+		sim.fire(ready[key]);
+		fired++;
+
+		// count the errors and mark them in the waveform, then keep going so
+		// the timing of the rest of the run is still measured
+		Stats &s = stats[key.first];
+		string error = "";
+		if (not sim.interference_errors.empty()) {
+			interference += (int64_t)sim.interference_errors.size();
+			error += "interference ";
+		}
+		if (not sim.instability_errors.empty()) {
+			instability += (int64_t)sim.instability_errors.size();
+			error += "instability ";
+		}
+		if (not sim.mutex_errors.empty()) {
+			mutexes += (int64_t)sim.mutex_errors.size();
+			error += "mutex ";
+		}
+		if (not error.empty()) {
+			s.errors++;
+			dump.markers.push_back(pair<uint64_t, string>(now, error + "at T" + std::to_string(key.first) + "." + std::to_string(key.second)));
+		}
+		sim.interference_errors.clear();
+		sim.instability_errors.clear();
+		sim.mutex_errors.clear();
+
+		dump.trigger(now, key.first);
+		if (s.count == 0) {
+			s.first = now;
+		}
+		s.last = now;
+		s.count++;
+	}
+
+	dump.close();
+
+	printf("%" PRId64 " transitions fired, stopped at %" PRIu64 "ps\n", fired, now);
+	printf("%" PRId64 " interference, %" PRId64 " instability and %" PRId64 " mutex errors\n", interference, instability, mutexes);
+	printf("transition\tcount\terrors\tfirst(ps)\tperiod(ps)\tthroughput(/ns)\n");
+	for (int i = 0; i < (int)stats.size(); i++) {
+		if (stats[i].count == 0) {
+			continue;
+		}
+		printf("T%d\t%" PRId64 "\t%" PRId64 "\t%" PRIu64, i, stats[i].count, stats[i].errors, stats[i].first);
+		if (stats[i].count > 1) {
+			double period = (double)(stats[i].last - stats[i].first)/(double)(stats[i].count-1);
+			printf("\t%.1f\t%.3f", period, period > 0.0 ? 1000.0/period : 0.0);
+		} else {
+			printf("\t-\t-");
+		}
+		printf("\n");
+	}
+}
+
+// The time of the earliest pending event of the production rule simulator
+uint64_t nextEvent(const prs::simulator &sim) {
+	uint64_t result = UINT64_MAX;
+	for (int i = 0; i < (int)sim.nets.size(); i++) {
+		if (sim.nets[i] != nullptr and sim.nets[i]->value.fire_at < result) {
+			result = sim.nets[i]->value.fire_at;
+		}
+	}
+	return result;
+}
+
+// Count the nets that are unknown in curr but weren't in prev. The encodings
+// pack 16 nets per word like in vcd::append, so unchanged words are skipped.
+int wentUnknown(const boolean::cube &prev, const boolean::cube &curr, int nets) {
+	int result = 0;
+	for (int w = 0; w < (int)curr.values.size() and w*16 < nets; w++) {
+		if (w < (int)prev.values.size() and prev.values[w] == curr.values[w]) {
+			continue;
+		}
+		for (int i = w*16; i < (w+1)*16 and i < nets; i++) {
+			if (curr.get(i) == -1 and prev.get(i) != -1) {
+				result++;
+			}
+		}
+	}
+	return result;
+}
+
+void prsim(prs::production_rule_set &pr, bool debug, const Batch &batch) {//, vector<prs::term_index> steps = vector<prs::term_index>()) {
 	prs::globals g(pr);
 	prs::simulator sim(&pr, debug);
 
 	vcd dump;
+	dump.packed = batch.packed;
 	dump.create(pr.name, pr);
 
 	tokenizer assignment_parser(false);
@@ -826,6 +1195,14 @@ void prsim(prs::production_rule_set &pr, bool debug) {//, vector<prs::term_index
 	char command[256];
 	bool done = false;
 	FILE *script = stdin;
+	bool quiet = batch.enabled;
+	if (batch.enabled) {
+		script = batch.source.empty() ? nullptr : fopen(batch.source.c_str(), "r");
+		if (script == nullptr and not batch.source.empty()) {
+			printf("error: file not found '%s'\n", batch.source.c_str());
+		}
+		done = (script == nullptr);
+	}
 	while (!done)
 	{
 		if (script == stdin)
@@ -836,6 +1213,10 @@ void prsim(prs::production_rule_set &pr, bool debug) {//, vector<prs::term_index
 		if (fgets(command, 255, script) == NULL && script != stdin)
 		{
 			fclose(script);
+			if (batch.enabled) {
+				// batch mode never reads from stdin
+				break;
+			}
 			script = stdin;
 			printf("(prsim)");
 			fflush(stdout);
@@ -988,7 +1369,9 @@ void prsim(prs::production_rule_set &pr, bool debug) {//, vector<prs::term_index
 
 				//boolean::cube old = sim.encoding;
 				auto e = sim.fire();
-				printf("%" PRIu64 "\t%s\n", e.fire_at, e.to_string(&pr).c_str());
+				if (not quiet) {
+					printf("%" PRIu64 "\t%s\n", e.fire_at, e.to_string(&pr).c_str());
+				}
 
 				dump.append(e.fire_at, sim.encoding, sim.strength);
 
@@ -1010,7 +1393,9 @@ void prsim(prs::production_rule_set &pr, bool debug) {//, vector<prs::term_index
 
 						//boolean::cube old = sim.encoding;
 						auto e = sim.fire(n);
-						printf("%" PRIu64 "\t%s\n", e.fire_at, e.to_string(&pr).c_str());
+						if (not quiet) {
+							printf("%" PRIu64 "\t%s\n", e.fire_at, e.to_string(&pr).c_str());
+						}
 			
 						dump.append(e.fire_at, sim.encoding, sim.strength);
 
@@ -1032,43 +1417,450 @@ void prsim(prs::production_rule_set &pr, bool debug) {//, vector<prs::term_index
 		}
 	}
 
+	if (batch.enabled) {
+		// Nothing is formatted per event, only the waveform is written. The
+		// simulator drives a net to X on interference or instability, so those
+		// are counted from the nets that go to X and marked in the waveform.
+		int64_t fired = 0;
+		int64_t unknown = 0;
+		uint64_t now = sim.enabled.now;
+		boolean::cube prev = sim.encoding;
+		while (batch.steps < 0 or fired < batch.steps) {
+			if (sim.enabled.empty()) {
+				sim.wait();
+				if (sim.enabled.empty()) {
+					break;
+				}
+			}
+
+			// The queue can't be peeked, so only pay for a scan of the enabled
+			// nets when there is a time limit.
+			if (batch.until != UINT64_MAX and nextEvent(sim) > batch.until) {
+				break;
+			}
+
+			auto e = sim.fire();
+			int x = wentUnknown(prev, sim.encoding, (int)pr.nets.size());
+			if (x > 0) {
+				unknown += x;
+				dump.markers.push_back(pair<uint64_t, string>(e.fire_at, "interference or instability at " + e.to_string(&pr)));
+			}
+			dump.append(e.fire_at, sim.encoding, sim.strength);
+			prev = sim.encoding;
+			now = e.fire_at;
+			fired++;
+		}
+		printf("%" PRId64 " transitions fired, stopped at %" PRIu64 "ps\n", fired, now);
+		printf("%" PRId64 " nets went unknown from interference or instability\n", unknown);
+	}
+
 	dump.close();
 }
 
-int sim_command(int argc, char **argv) {
-	parse_ucs::function::registry.insert({"func", parse_ucs::language(&parse_cog::produce, &parse_cog::expect, &parse_cog::register_syntax)});
-	parse_ucs::function::registry.insert({"proto", parse_ucs::language(&parse_cog::produce, &parse_cog::expect, &parse_cog::register_syntax)});
-	parse_ucs::function::registry.insert({"circ", parse_ucs::language(&parse_prs::produce, &parse_prs::expect, &parse_prs::register_syntax)});
+// Simulate batch.vectors random stimulus vectors at once, one per bit lane.
+// Every cycle the inputs get new random values and the circuit either
+// settles (zero delay) or takes one step (unit delay).
+void prvectors(prs::production_rule_set &pr, const Batch &batch) {
+	LaneSim sim((int)pr.nets.size(), batch.vectors);
+	vector<LaneRule> rules = laneRules(pr);
+	for (auto r = rules.begin(); r != rules.end(); r++) {
+		sim.addRule(*r);
+	}
 
-	weaver::Term::pushDialect("func", factoryCog);
-	weaver::Term::pushDialect("proto", factoryCogw);
-	weaver::Term::pushDialect("circ", factoryPrs);
+	std::mt19937_64 rng(batch.seed);
+	int64_t cycles = batch.steps < 0 ? 100 : batch.steps;
+	int64_t steps = 0;
+	for (int64_t c = 0; c < cycles; c++) {
+		sim.randomize(rng);
+		if (batch.unit) {
+			sim.step();
+			steps++;
+		} else {
+			steps += sim.settle(4*(int)pr.nets.size() + 16);
+		}
+	}
+
+	printf("%d vectors, %" PRId64 " cycles, %" PRId64 " %s steps\n", batch.vectors, cycles, steps, batch.unit ? "unit delay" : "zero delay");
+	printf("%d lanes with interference, %d lanes did not settle\n", sim.count(sim.conflict), batch.unit ? 0 : sim.count(sim.unstable));
+
+	ucs::ConstNetlist nets(pr);
+	for (int n = 0; n < sim.nets; n++) {
+		if (not sim.driven[n]) {
+			continue;
+		}
+		int unknown = 0;
+		for (int lane = 0; lane < sim.vectors; lane++) {
+			unknown += (sim.get(n, lane) < 0);
+		}
+		if (unknown > 0) {
+			printf("\t%s unknown in %d lanes\n", nets.netAt(n).c_str(), unknown);
+		}
+	}
+}
+
+// Pack a simulator state into a string: its marking, the transitions it has
+// loaded and its encodings. The whole state is kept rather than a digest so
+// that no two states are ever confused. Time is left out so the state space
+// stays finite.
+string hsestate(const hse::simulator &sim) {
+	string result;
+	auto put = [&result](const void *data, size_t size) {
+		result.append((const char *)data, size);
+	};
+
+	vector<int> marking;
+	for (int i = 0; i < (int)sim.tokens.size(); i++) {
+		marking.push_back(sim.tokens[i].index);
+	}
+	sort(marking.begin(), marking.end());
+	int count = (int)marking.size();
+	put(&count, sizeof(count));
+	put(marking.data(), marking.size()*sizeof(int));
+
+	vector<int> loaded;
+	for (int i = 0; i < (int)sim.loaded.size(); i++) {
+		loaded.push_back(sim.loaded[i].index);
+	}
+	sort(loaded.begin(), loaded.end());
+	count = (int)loaded.size();
+	put(&count, sizeof(count));
+	put(loaded.data(), loaded.size()*sizeof(int));
+
+	count = (int)sim.encoding.values.size();
+	put(&count, sizeof(count));
+	put(sim.encoding.values.data(), sim.encoding.values.size()*sizeof(sim.encoding.values[0]));
+	count = (int)sim.global.values.size();
+	put(&count, sizeof(count));
+	put(sim.global.values.data(), sim.global.values.size()*sizeof(sim.global.values[0]));
+	return result;
+}
+
+// A state reached by --explore, stored as the transition that reached it
+// from its parent so its trace can be rebuilt.
+struct Reached {
+	int64_t parent;
+	hse::term_index fired;
+};
+
+// A state waiting to be expanded. States past the memory budget drop their
+// simulator and are rebuilt by replaying their trace from reset.
+struct Pending {
+	int64_t node;
+	std::optional<hse::simulator> sim;
+};
+
+struct Hazard {
+	string message;
+	int64_t parent;
+	hse::term_index fired;
+};
+
+vector<hse::term_index> hsetrace(const vector<Reached> &nodes, int64_t node) {
+	vector<hse::term_index> trace;
+	for (; node >= 0 and nodes[node].parent >= 0; node = nodes[node].parent) {
+		trace.push_back(nodes[node].fired);
+	}
+	reverse(trace.begin(), trace.end());
+	return trace;
+}
+
+bool hsereplay(hse::graph &g, const vector<hse::term_index> &trace, hse::simulator &sim) {
+	sim = hse::simulator(&g, g.reset[0]);
+	for (auto t = trace.begin(); t != trace.end(); t++) {
+		sim.enabled();
+		int firing = 0;
+		while (firing < (int)sim.ready.size() and (sim.loaded[sim.ready[firing].first].index != t->index or sim.ready[firing].second != t->term)) {
+			firing++;
+		}
+		if (firing == (int)sim.ready.size()) {
+			return false;
+		}
+		sim.fire(firing);
+		sim.interference_errors.clear();
+		sim.instability_errors.clear();
+		sim.mutex_errors.clear();
+	}
+	return true;
+}
+
+// Search every interleaving of g breadth first, one level at a time. The
+// states of a level are split across the pool, and each worker drops the
+// states it reaches that were already seen in an earlier level. The new
+// states are then merged in task order and deduplicated, so the node ids and
+// reported traces do not depend on scheduling. Every hazard is reported
+// once, with the shortest trace that reaches it saved as a .sim file that
+// replays it in hsesim. With --spill, the visited states are moved to sorted
+// runs on disk whenever there are too many to hold, and the states a level
+// reaches are checked against the runs in one pass when they are merged.
+void hseexplore(hse::graph &g, const Batch &batch) {
+	if (g.reset.empty()) {
+		printf("error: no reset state to start the simulation from\n");
+		return;
+	}
+
+	struct Child {
+		int64_t parent;
+		hse::term_index fired;
+		string state;
+		std::optional<hse::simulator> sim;
+	};
+
+	ShardedSet<string> seen;
+	vector<Reached> nodes;
+	vector<Pending> frontier;
+	map<string, Hazard> hazards;
+
+	nodes.push_back(Reached{-1, hse::term_index()});
+	frontier.push_back(Pending{0, hse::simulator(&g, g.reset[0])});
+	seen.insert(hsestate(*frontier[0].sim));
+
+	SortedRuns spilled;
+	if (batch.spill >= 0 and not spilled.open(fs::temp_directory_path() / ("lm_explore_" + std::to_string((int)getpid())))) {
+		printf("error: unable to create a directory for the spilled states\n");
+		return;
+	}
+
+	ThreadPool pool(batch.jobs);
+	int64_t depth = 0;
+	for (; not frontier.empty() and (batch.steps < 0 or depth < batch.steps); depth++) {
+		int tasks = min((int)frontier.size(), max(1, pool.size()*4));
+		int64_t budget = (int64_t)batch.states/tasks;
+		vector<vector<Child> > children(tasks);
+		vector<vector<Hazard> > found(tasks);
+		for (int k = 0; k < tasks; k++) {
+			pool.push([&, k]() {
+				int64_t kept = 0;
+				// contiguous slices, so merging in task order is frontier order
+				size_t lo = frontier.size()*k/tasks;
+				size_t hi = frontier.size()*(k+1)/tasks;
+				for (size_t i = lo; i < hi; i++) {
+					hse::simulator sim;
+					if (frontier[i].sim.has_value()) {
+						sim = std::move(*frontier[i].sim);
+						frontier[i].sim.reset();
+					} else if (not hsereplay(g, hsetrace(nodes, frontier[i].node), sim)) {
+						continue;
+					}
+
+					int enabled = sim.enabled();
+					for (int j = 0; j < enabled; j++) {
+						hse::term_index t(sim.loaded[sim.ready[j].first].index, sim.ready[j].second);
+						hse::simulator next = sim;
+						next.fire(j);
+
+						if (not next.interference_errors.empty() or not next.instability_errors.empty() or not next.mutex_errors.empty()) {
+							string desc = "T" + std::to_string(t.index) + "." + std::to_string(t.term) + " "
+								+ export_expression(sim.loaded[sim.ready[j].first].guard_action, g).to_string() + " -> "
+								+ export_composition(g.transitions[t.index].local_action[t.term], g).to_string();
+							if (not next.interference_errors.empty()) {
+								found[k].push_back(Hazard{"interference at " + desc, frontier[i].node, t});
+							}
+							if (not next.instability_errors.empty()) {
+								found[k].push_back(Hazard{"instability at " + desc, frontier[i].node, t});
+							}
+							if (not next.mutex_errors.empty()) {
+								found[k].push_back(Hazard{"mutex violation at " + desc, frontier[i].node, t});
+							}
+							next.interference_errors.clear();
+							next.instability_errors.clear();
+							next.mutex_errors.clear();
+						}
+
+						string state = hsestate(next);
+						if (not seen.contains(state)) {
+							children[k].push_back(Child{frontier[i].node, t, state, std::nullopt});
+							if (kept++ < budget) {
+								children[k].back().sim = std::move(next);
+							}
+						}
+					}
+				}
+			});
+		}
+		pool.wait();
+
+		// the workers only checked the states in memory
+		vector<string> fresh;
+		if (spilled.runs > 0) {
+			vector<string> reached;
+			for (int k = 0; k < tasks; k++) {
+				for (auto c = children[k].begin(); c != children[k].end(); c++) {
+					reached.push_back(c->state);
+				}
+			}
+			fresh = spilled.missing(reached);
+		}
+
+		// Merge in task order, which is frontier order, so the first parent to
+		// reach a state depends on neither scheduling nor the number of jobs
+		frontier.clear();
+		for (int k = 0; k < tasks; k++) {
+			for (auto h = found[k].begin(); h != found[k].end(); h++) {
+				hazards.insert(pair<string, Hazard>(h->message, *h));
+			}
+			for (auto c = children[k].begin(); c != children[k].end(); c++) {
+				if (spilled.runs > 0 and not std::binary_search(fresh.begin(), fresh.end(), c->state)) {
+					continue;
+				}
+				if (not seen.insert(c->state)) {
+					continue;
+				}
+				nodes.push_back(Reached{c->parent, c->fired});
+				frontier.push_back(Pending{(int64_t)nodes.size()-1, std::move(c->sim)});
+			}
+		}
+
+		if (batch.spill >= 0 and (int64_t)seen.size() > batch.spill and not spilled.add(seen.take())) {
+			printf("error: unable to spill the visited states to disk\n");
+			break;
+		}
+	}
+
+	int index = 0;
+	for (auto h = hazards.begin(); h != hazards.end(); h++, index++) {
+		vector<hse::term_index> trace = hsetrace(nodes, h->second.parent);
+		trace.push_back(h->second.fired);
+
+		string path = g.name + "_hazard" + std::to_string(index) + ".sim";
+		FILE *seq = fopen(path.c_str(), "w");
+		if (seq != nullptr) {
+			for (int i = 0; i < (int)trace.size(); i++) {
+				fprintf(seq, "%d.%d\n", trace[i].index, trace[i].term);
+			}
+			fclose(seq);
+		}
+		printf("%s\n", h->first.c_str());
+		printf("\treached after %d transitions, replay with %s\n", (int)trace.size(), path.c_str());
+	}
+
+	printf("%d states explored to depth %" PRId64 "%s, %d hazards\n", (int)nodes.size(), depth, frontier.empty() ? "" : " (incomplete)", (int)hazards.size());
+	if (spilled.runs > 0) {
+		printf("%zu visited states spilled to disk in %d runs\n", spilled.count, spilled.runs);
+	}
+}
+
+int sim_command(int argc, char **argv) {
+	registerDialects();
 
 	weaver::Project proj;
 	if (proj.hasMod()) {
 		proj.readMod();
 	}
 
-	proj.pushFiletype("", "wv", "", readWv, loadWv);
-	proj.pushFiletype("func", "cog", "", readCog, loadCog);
-	proj.pushFiletype("proto", "cogw", "", readCog, loadCogw);
-	proj.pushFiletype("circ", "prs", "ckt", readPrs, loadPrs, writePrs);
-	proj.pushFiletype("spice", "spi", "spi", readSpice, loadSpice, writeSpice);
-	proj.pushFiletype("verilog", "v", "rtl", nullptr, nullptr, writeVerilog);
-	proj.pushFiletype("layout", "gds", "gds", nullptr, loadGds, writeGds);
-	proj.pushFiletype("func", "astg", "state", readAstg, loadAstg, writeAstg);
-	proj.pushFiletype("proto", "astgw", "state", readAstg, loadAstgw, writeAstgw);
+	registerFiletypes(proj);
 
 	Proto proto;
 
 	string sfilename = "";
 	bool debug = false;
+	Batch batch;
 
 	for (int i = 0; i < argc; i++) {
 		string arg = argv[i];
 
 		if (arg == "--verbose" or arg == "-v") {
 			set_verbose(true);
+		} else if (arg == "--batch" or arg == "-b") {
+			batch.enabled = true;
+		} else if (arg == "--steps") {
+			if (++i >= argc) {
+				printf("expected number of steps.\n");
+				return 0;
+			}
+			batch.steps = atoll(argv[i]);
+		} else if (arg == "--until") {
+			if (++i >= argc) {
+				printf("expected simulation time.\n");
+				return 0;
+			}
+			batch.until = strtoull(argv[i], nullptr, 10);
+		} else if (arg == "--delay") {
+			if (++i >= argc) {
+				printf("expected delay specification.\n");
+				return 0;
+			}
+			string spec = argv[i];
+			Delay delay;
+			size_t eq = spec.find('=');
+			if (eq != string::npos and spec.size() > 1 and spec[0] == 'T') {
+				if (not delay.parse(spec.substr(eq+1))) {
+					printf("unrecognized delay '%s'\n", spec.c_str());
+					return 0;
+				}
+				batch.delays[atoi(spec.substr(1, eq-1).c_str())] = delay;
+			} else if (delay.parse(spec)) {
+				batch.delay = delay;
+			} else {
+				printf("unrecognized delay '%s'\n", spec.c_str());
+				return 0;
+			}
+		} else if (arg == "--wave") {
+			if (++i >= argc) {
+				printf("expected waveform format.\n");
+				return 0;
+			}
+			string format = argv[i];
+			if (format != "vcd" and format != "lmw") {
+				printf("unrecognized waveform format '%s'\n", format.c_str());
+				return 0;
+			}
+			batch.packed = (format == "lmw");
+		} else if (arg == "--seeds") {
+			if (++i >= argc) {
+				printf("expected range of seeds.\n");
+				return 0;
+			}
+			string range = argv[i];
+			size_t dots = range.find("..");
+			batch.seeds.first = strtoull(range.substr(0, dots).c_str(), nullptr, 10);
+			batch.seeds.second = dots == string::npos ? batch.seeds.first : strtoull(range.substr(dots+2).c_str(), nullptr, 10);
+			if (batch.seeds.first > batch.seeds.second) {
+				printf("empty range of seeds '%s'\n", range.c_str());
+				return 0;
+			}
+		} else if (arg == "--vectors") {
+			if (++i >= argc) {
+				printf("expected number of vectors.\n");
+				return 0;
+			}
+			batch.vectors = atoi(argv[i]);
+		} else if (arg == "--unit-delay") {
+			batch.unit = true;
+		} else if (arg == "--explore") {
+			batch.explore = true;
+		} else if (arg == "--states") {
+			if (++i >= argc) {
+				printf("expected number of states.\n");
+				return 0;
+			}
+			batch.states = atoll(argv[i]);
+		} else if (arg == "--spill") {
+			if (++i >= argc) {
+				printf("expected number of states.\n");
+				return 0;
+			}
+			batch.spill = atoll(argv[i]);
+		} else if (arg == "--jobs" or arg == "-j") {
+			if (++i >= argc) {
+				printf("expected number of jobs.\n");
+				return 0;
+			}
+			batch.jobs = atoi(argv[i]);
+			if (batch.jobs <= 0) {
+				batch.jobs = ThreadPool::concurrency();
+			}
+		} else if (arg == "--seed") {
+			if (++i >= argc) {
+				printf("expected random seed.\n");
+				return 0;
+			}
+			batch.seed = strtoull(argv[i], nullptr, 10);
+		} else if (arg == "--source") {
+			if (++i >= argc) {
+				printf("expected path to command file.\n");
+				return 0;
+			}
+			batch.source = argv[i];
 		} else if (arg == "--debug" or arg == "-d") {
 			set_debug(true);
 			debug = true;
@@ -1119,6 +1911,15 @@ int sim_command(int argc, char **argv) {
 	}
 
 	const weaver::Term &fn = prgm.termAt(curr[0]);
+	if (batch.enabled and fn.dialect().name != "circ" and fn.dialect().name != "func") {
+		printf("warning: --batch is only supported for chp and production rules\n");
+	}
+	if ((batch.explore or batch.seeds.first <= batch.seeds.second) and fn.dialect().name != "proto") {
+		printf("warning: --seeds and --explore are only supported for handshaking expansions\n");
+	}
+	if (batch.vectors > 0 and fn.dialect().name != "circ") {
+		printf("warning: --vectors is only supported for production rules\n");
+	}
 
 	if (fn.dialect().name == "func") {
 		vector<chp::term_index> steps;
@@ -1140,7 +1941,11 @@ int sim_command(int argc, char **argv) {
 
 		chp::graph g = fn.as<chp::graph>();
 		g.post_process(true);
-		chpsim(g, steps);
+		if (batch.enabled) {
+			chptime(g, batch);
+		} else {
+			chpsim(g, steps);
+		}
 	} else if (fn.dialect().name == "proto") {
 		vector<hse::term_index> steps;
 		if (sfilename != "") {
@@ -1160,7 +1965,13 @@ int sim_command(int argc, char **argv) {
 		}
 		
 		hse::graph g = fn.as<hse::graph>();
-		hsesim(g, steps);
+		if (batch.explore) {
+			hseexplore(g, batch);
+		} else if (batch.seeds.first <= batch.seeds.second) {
+			hsecampaign(g, batch);
+		} else {
+			hsesim(g, steps, batch.packed);
+		}
 	} else if (fn.dialect().name == "circ") {
 		/*vector<prs::term_index> steps;
 		if (sfilename != "") {
@@ -1187,7 +1998,11 @@ int sim_command(int argc, char **argv) {
 			printf("\n\n");
 		}
 
-		prsim(pr, debug);//, steps);
+		if (batch.vectors > 0) {
+			prvectors(pr, batch);
+		} else {
+			prsim(pr, debug, batch);//, steps);
+		}
 	} else {
 		error("", "unrecognized dialect '" + fn.dialect().name + "'", __FILE__, __LINE__);
 	}
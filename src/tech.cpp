@@ -46,6 +46,7 @@
 #include <interpret_arithmetic/import.h>
 
 #include "weaver/project.h"
+#include "format/gds.h"
 
 #include <filesystem>
 #include <chrono>
@@ -66,6 +67,7 @@ void tech_help() {
 	printf("  set <tech>          set the current technology node\n");
 	//printf("  import <pdk>        import the technology rules and cell library from a process design kit\n");
 	printf("  cells <cell.gds...>  import the cells into the cell library\n");
+	printf("      -c,--cell <name>  only import the structure with this name, may be repeated\n");
 	//printf("  check [cell name...]    run DRC/LVS checks against your cells\n");
 	//printf("  push [cell name...]     share your cell layouts with others using the same technology\n");
 	//printf("  drop [cell name...]     delete these cells from your cell library\n");
@@ -73,12 +75,19 @@ void tech_help() {
 
 int tech_cells_command(string workingDir, string techDir, string techPath, string cellsDir, int argc, char **argv) {
 	vector<string> files;
+	std::set<string> cells;
 
 	for (int i = 0; i < argc; i++) {
 		string arg = argv[i];
 
 		if (arg == "") {
 			// placeholder for arguments
+		} else if (arg == "--cell" or arg == "-c") {
+			if (++i >= argc) {
+				printf("expected cell name.\n");
+				return 0;
+			}
+			cells.insert(argv[i]);
 		} else {
 			string path = extractPath(arg);
 			string opt = (arg.size() > path.size() ? arg.substr(path.size()+1) : "");
@@ -103,7 +112,7 @@ int tech_cells_command(string workingDir, string techDir, string techPath, strin
 	}
 
 	phy::Tech tech(techPath, cellsDir);
-	if (not phy::loadTech(tech)) {
+	if (not weaver::loadTech(tech)) {
 		cout << "techfile does not exist \'" + techPath + "\'." << endl;
 		return 1;
 	}
@@ -112,24 +121,23 @@ int tech_cells_command(string workingDir, string techDir, string techPath, strin
 	printf("Importing cells...\n");
 	for (auto path = files.begin(); path != files.end(); path++) {
 		printf("\t%s\n", path->c_str());
-		phy::Library lib(tech);
-		import_library(lib, *path);
-		if (lib.macros.empty()) {
-			continue;
-		}
+		// Structures are imported, extracted and written one at a time so that
+		// large libraries don't have to fit in memory.
+		bool found = visit_gds(tech, extractPath(*path), [&](phy::Layout &gds) {
+			gds.trace();
+			sch::Netlist net;
+			net.subckts.push_back(sch::Subckt(true));
+			auto spi = net.subckts.begin();
+			extract(*spi, gds, true);
+			spi->name = gds.name;
 
-		sch::Netlist net;
-		extract(net, lib);
-		for (int i = 0; i < (int)net.subckts.size(); i++) {
-			auto spi = net.subckts.begin()+i;
-			auto gds = lib.macros.begin()+i;
 			printf("\t\t%s -> ", spi->name.c_str());
 			fflush(stdout);
 			spi->cleanDangling(true);
 			spi->combineDevices();
 			spi->canonicalize();
 			spi->name = "cell_" + sch::idToString(spi->id);
-			gds->name = spi->name;
+			gds.name = spi->name;
 			printf("%s\n", spi->name.c_str());	
 
 			if (not libFound) {
@@ -138,9 +146,12 @@ int tech_cells_command(string workingDir, string techDir, string techPath, strin
 			}
 		
 			string cellPath = tech.lib + "/" + spi->name;
-			export_layout(cellPath+".gds", *gds);
-			export_lef(cellPath+".lef", *gds);
+			export_layout(cellPath+".gds", gds);
+			export_lef(cellPath+".lef", gds);
 			export_spi(cellPath+".spi", tech, net, *spi);
+		}, cells);
+		if (not found) {
+			printf("error: unable to read gds file '%s'\n", path->c_str());
 		}
 	}
 
@@ -19,6 +19,7 @@
 #include "weaver/unpacker.h"
 #include "weaver/project.h"
 #include "weaver/cli.h"
+#include "weaver/pool.h"
 
 #include "format/cog.h"
 #include "format/spice.h"
@@ -27,11 +28,13 @@
 #include "format/prs.h"
 #include "format/wv.h"
 #include "format/astg.h"
+#include "format/filetypes.h"
 
 void unpack_help() {
 	printf("Usage: lm unpack [options] <file>\n");
 	printf("Reverse the synthesis process.\n");
 	printf("\nOptions:\n");
+	printf(" -j,--jobs <N>  extract the macros and subckts of each term on N threads (0 uses every core)\n");
 	printf(" --all          save all intermediate stages\n");
 	printf(" -n,--nets      save the extracted netlist\n");
 	printf(" -s,--size      save the extracted sized production rules\n");
@@ -42,28 +45,14 @@ void unpack_help() {
 }
 
 int unpack_command(int argc, char **argv) {
-	parse_ucs::function::registry.insert({"func", parse_ucs::language(&parse_cog::produce, &parse_cog::expect, &parse_cog::register_syntax)});
-	parse_ucs::function::registry.insert({"proto", parse_ucs::language(&parse_cog::produce, &parse_cog::expect, &parse_cog::register_syntax)});
-	parse_ucs::function::registry.insert({"circ", parse_ucs::language(&parse_prs::produce, &parse_prs::expect, &parse_prs::register_syntax)});
-
-	weaver::Term::pushDialect("func", factoryCog);
-	weaver::Term::pushDialect("proto", factoryCogw);
-	weaver::Term::pushDialect("circ", factoryPrs);
+	registerDialects();
 
 	weaver::Project proj;
 	if (proj.hasMod()) {
 		proj.readMod();
 	}
 
-	proj.pushFiletype("", "wv", "", readWv, loadWv);
-	proj.pushFiletype("func", "cog", "", readCog, loadCog);
-	proj.pushFiletype("proto", "cogw", "", readCog, loadCogw);
-	proj.pushFiletype("circ", "prs", "ckt", readPrs, loadPrs, writePrs);
-	proj.pushFiletype("spice", "spi", "spi", readSpice, loadSpice, writeSpice);
-	proj.pushFiletype("verilog", "v", "rtl", nullptr, nullptr, writeVerilog);
-	proj.pushFiletype("layout", "gds", "gds", nullptr, loadGds, writeGds);
-	proj.pushFiletype("func", "astg", "state", readAstg, loadAstg, writeAstg);
-	proj.pushFiletype("proto", "astgw", "state", readAstg, loadAstgw, writeAstgw);
+	registerFiletypes(proj);
 
 	vector<Proto> protos;
 
@@ -77,6 +66,15 @@ int unpack_command(int argc, char **argv) {
 		} else if (arg == "--debug" or arg == "-d") {
 			set_debug(true);
 			unpacker.debug = true;
+		} else if (arg == "--jobs" or arg == "-j") {
+			if (++i >= argc) {
+				printf("expected number of jobs.\n");
+				return 0;
+			}
+			unpacker.jobs = atoi(argv[i]);
+			if (unpacker.jobs <= 0) {
+				unpacker.jobs = ThreadPool::concurrency();
+			}
 		} else if (arg == "--all") {
 			unpacker.inclAll();
 		} else if (arg == "-l" or arg == "--layout") {
@@ -94,6 +92,7 @@ int unpack_command(int argc, char **argv) {
 	weaver::Program prgm;
 	loadGlobalTypes(prgm);
 
+	proj.jobs = unpacker.jobs;
 	if (protos.empty()) {
 		proj.incl("top.wv");
 		proj.load(prgm);
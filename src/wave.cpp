@@ -0,0 +1,83 @@
+#include "wave.h"
+
+#include <common/standard.h>
+
+#include "format/vcd.h"
+#include "format/wave.h"
+
+void wave_help() {
+	printf("Usage: lm wave [options] <file.lmw>\n");
+	printf("Convert a waveform written by \"lm sim --wave lmw\" to a .vcd that waveform\n");
+	printf("viewers can read. The .gtkw written by the simulation names this .vcd.\n");
+
+	printf("\nOptions:\n");
+	printf(" -o <file.vcd>    write the waveform here (default: <file>.vcd)\n");
+	printf(" --from <time>    start the waveform at this time in ps (default: 0)\n");
+	printf(" --to <time>      end the waveform at this time in ps (default: the end)\n");
+}
+
+int wave_command(int argc, char **argv) {
+	string path = "";
+	string output = "";
+	uint64_t from = 0;
+	uint64_t to = ~(uint64_t)0;
+
+	for (int i = 0; i < argc; i++) {
+		string arg = argv[i];
+		if (arg == "-o") {
+			if (++i >= argc) {
+				printf("expected output filename.\n");
+				return 0;
+			}
+			output = argv[i];
+		} else if (arg == "--from") {
+			if (++i >= argc) {
+				printf("expected simulation time.\n");
+				return 0;
+			}
+			from = strtoull(argv[i], nullptr, 10);
+		} else if (arg == "--to") {
+			if (++i >= argc) {
+				printf("expected simulation time.\n");
+				return 0;
+			}
+			to = strtoull(argv[i], nullptr, 10);
+		} else {
+			path = arg;
+		}
+	}
+
+	if (path.empty()) {
+		wave_help();
+		return 0;
+	}
+
+	if (output.empty()) {
+		size_t dot = path.find_last_of(".");
+		output = path.substr(0, dot) + ".vcd";
+	}
+	if (output.size() < 4 or output.substr(output.size()-4) != ".vcd") {
+		printf("error: output must be a .vcd file\n");
+		return 1;
+	}
+
+	// The names are only known once the header is read, so the .vcd is
+	// created when the first value is reported.
+	vcd dump;
+	vector<string> names;
+	bool created = false;
+	bool found = read_wave(path, from, to, names, [&](uint64_t t, int net, char value) {
+		if (not created) {
+			dump.createWires(output.substr(0, output.size()-4), names);
+			created = true;
+		}
+		dump.stamp(t);
+		dump.change(value, net);
+	});
+	if (not found) {
+		printf("error: unable to read waveform '%s'\n", path.c_str());
+		return 1;
+	}
+	dump.close();
+	return 0;
+}
@@ -0,0 +1,4 @@
+#pragma once
+
+void wave_help();
+int wave_command(int argc, char **argv);
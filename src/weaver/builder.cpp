@@ -1,8 +1,14 @@
 #include "builder.h"
 
+#include <cassert>
 #include <filesystem>
+#include <functional>
+#include <memory>
+#include <set>
+#include <shared_mutex>
 
 #include <common/standard.h>
+#include <common/message.h>
 #include <common/timer.h>
 #include <common/text.h>
 
@@ -31,8 +37,10 @@
 
 #include "../format/cell.h"
 #include "../format/dot.h"
+#include "hash.h"
+#include "profile.h"
 
-Build::Build(weaver::Project &proj) : proj(proj) {
+Build::Build(weaver::Project &proj) : proj(proj), cache(proj) {
 	logic = LOGIC_CMOS;
 	timing = TIMING_MIXED;
 	stage = -1;
@@ -42,10 +50,15 @@ Build::Build(weaver::Project &proj) : proj(proj) {
 
 	noCells = false;
 	noGhosts = false;
+	noCache = false;
+	stream = false;
 
 	progress = false;
 	debug = false;
 	format_expressions_as_html_table = false;
+
+	jobs = 1;
+	profile = nullptr;
 	
 	targets.resize(ROUTE+1, false);
 }
@@ -78,40 +91,339 @@ bool Build::has(int target) const {
 	return targets[target];
 }
 
-void doPlacement(phy::Library &lib, sch::Netlist &lst, gdstk::GdsWriter *stream=nullptr, map<int, gdstk::Cell*> *cells=nullptr, bool progress=false, bool debug=false) {
-	if (progress) {
-		printf("Placing Cells:\n");
+// Whether module mod should be lowered in this build. When only is empty
+// every module is. Otherwise mod must be one of the modules in only, or be
+// derived from one of them.
+bool Build::selected(string mod) const {
+	if (only.empty()) {
+		return true;
+	}
+	// lowering module m creates m>>flow, m>>circ, ...
+	size_t split = mod.find(">>");
+	while (true) {
+		if (only.find(mod.substr(0, split)) != only.end()) {
+			return true;
+		}
+		if (split == string::npos) {
+			return false;
+		}
+		split = mod.find(">>", split+2);
 	}
+}
 
-	if (lib.macros.size() < lst.subckts.size()) {
-		lib.macros.resize(lst.subckts.size(), Layout(*lib.tech));
+// Whether the result of the stages from through to may be taken from the
+// cache. Stages that were asked to emit debug output always run.
+bool Build::cacheable(int from, int to) const {
+	if (noCache or debug) {
+		return false;
 	}
+	for (int i = from; i <= to; i++) {
+		if (has(i)) {
+			return false;
+		}
+	}
+	return true;
+}
 
-	sch::Placer placer(lib, lst, 0, 0, progress, debug);
+string Build::cacheKey(string lowering, string input, bool useTech, const vector<string> &cells) const {
+	// bump this when the stored format of a cache entry changes
+	static const int version = 3;
+
+	Hasher hash;
+	hash.add(version);
+	hash.add(lowering);
+	hash.add(input);
+	hash.add(logic);
+	hash.add(timing);
+	hash.add(stage);
+	hash.add(noGhosts);
+	hash.add(noCells);
+	if (useTech) {
+		hash.add(proj.tech.path);
+		hash.add(proj.tech.lib);
+		hash.addFile(extractPath(proj.tech.path));
+	}
 
-	Timer total;
+	// Cached layouts are made of these cells, so an edit to one of their
+	// layouts must invalidate them. Other cells in the library don't matter.
+	for (auto i = cells.begin(); i != cells.end(); i++) {
+		hash.add(*i);
+		if (not hash.addFile(fs::path(proj.tech.lib) / (*i + ".gds"))) {
+			hash.add((int64_t)-1);
+		}
+	}
+	return hash.to_string();
+}
+
+// Count the cells, or the subckts that are placed from cells.
+// The names of the library cells that a mapped netlist instantiates
+vector<string> cellNames(const sch::Netlist &lst) {
+	vector<string> result;
+	for (int i = 0; i < (int)lst.subckts.size(); i++) {
+		if (lst.subckts[i].isCell) {
+			result.push_back(lst.subckts[i].name);
+		}
+	}
+	return result;
+}
+
+int64_t countSubckts(const sch::Netlist &lst, bool isCell) {
+	int64_t result = 0;
+	for (int i = 0; i < (int)lst.subckts.size(); i++) {
+		if (lst.subckts[i].isCell == isCell) {
+			result++;
+		}
+	}
+	return result;
+}
+
+// Sum the area of the cells, or of the placed subckts, in the library.
+int64_t countArea(const phy::Library &lib, const sch::Netlist &lst, bool isCell) {
+	int64_t result = 0;
+	for (int i = 0; i < (int)lst.subckts.size() and i < (int)lib.macros.size(); i++) {
+		if (lst.subckts[i].isCell == isCell) {
+			result += lib.macros[i].box.area();
+		}
+	}
+	return result;
+}
+
+// Place subckt i into its macro. Returns the area of the cells it
+// instantiates for the progress report.
+int placeSubckt(sch::Placer &placer, phy::Library &lib, sch::Netlist &lst, int i) {
+	lib.macros[i].name = lst.subckts[i].name;
+	placer.place(i);
+	int area = 0;
+	for (auto j = lst.subckts[i].inst.begin(); j != lst.subckts[i].inst.end(); j++) {
+		if (lst.subckts[j->subckt].isCell) {
+			area += lib.macros[j->subckt].box.area();
+		}
+	}
+	return area;
+}
+
+// Free a gdstk cell created by export_layout, along with its allocation.
+void freeCell(gdstk::Cell *cell) {
+	if (cell != nullptr) {
+		cell->free_all();
+		gdstk::free_allocation(cell);
+	}
+}
+
+// When streaming, a macro is written out as soon as it is placed. It is kept
+// in memory only until every subckt that instantiates it has been placed, and
+// then released along with its gdstk cell.
+struct Release {
+	Release(phy::Library &lib, sch::Netlist &lst, map<int, gdstk::Cell*> *cells);
+
+	phy::Library &lib;
+	sch::Netlist &lst;
+	map<int, gdstk::Cell*> *cells;
+
+	// number of parents of each subckt that have yet to be placed
+	vector<int> users;
+	vector<bool> written;
+
+	// subckt i has been placed and written to the stream
+	void done(int i);
+	void free(int i);
+};
+
+Release::Release(phy::Library &lib, sch::Netlist &lst, map<int, gdstk::Cell*> *cells) : lib(lib), lst(lst), cells(cells) {
+	users.resize(lst.subckts.size(), 0);
+	written.resize(lst.subckts.size(), false);
 	for (int i = 0; i < (int)lst.subckts.size(); i++) {
-		if (not lst.subckts[i].isCell) {
+		// cells are written by update_library
+		written[i] = lst.subckts[i].isCell;
+
+		std::set<int> children;
+		for (auto j = lst.subckts[i].inst.begin(); j != lst.subckts[i].inst.end(); j++) {
+			if (j->subckt != i) {
+				children.insert(j->subckt);
+			}
+		}
+		for (auto j = children.begin(); j != children.end(); j++) {
+			users[*j]++;
+		}
+	}
+}
+
+void Release::done(int i) {
+	written[i] = true;
+
+	std::set<int> children;
+	for (auto j = lst.subckts[i].inst.begin(); j != lst.subckts[i].inst.end(); j++) {
+		if (j->subckt != i) {
+			children.insert(j->subckt);
+		}
+	}
+	for (auto j = children.begin(); j != children.end(); j++) {
+		if (--users[*j] == 0 and written[*j]) {
+			free(*j);
+		}
+	}
+	if (users[i] == 0) {
+		free(i);
+	}
+}
+
+void Release::free(int i) {
+	if (i < (int)lib.macros.size()) {
+		lib.macros[i].clear();
+	}
+	if (cells != nullptr) {
+		auto cell = cells->find(i);
+		if (cell != cells->end()) {
+			freeCell(cell->second);
+			cells->erase(cell);
+		}
+	}
+}
+
+// Place the subckts in dependency order on a thread pool. A subckt is ready
+// once every subckt it instantiates has been placed, so the leaves go first
+// and each parent starts as soon as its children's macros exist.
+void doParallelPlacement(phy::Library &lib, sch::Netlist &lst, gdstk::GdsWriter *stream, map<int, gdstk::Cell*> *cells, Release *release, bool progress, bool debug, int jobs) {
+	int count = (int)lst.subckts.size();
+	vector<vector<int> > parents(count);
+	vector<int> waiting(count, 0);
+	vector<bool> placed(count, false);
+	for (int i = 0; i < count; i++) {
+		if (lst.subckts[i].isCell) {
+			continue;
+		}
+
+		std::set<int> children;
+		for (auto j = lst.subckts[i].inst.begin(); j != lst.subckts[i].inst.end(); j++) {
+			if (j->subckt != i and not lst.subckts[j->subckt].isCell) {
+				children.insert(j->subckt);
+			}
+		}
+		waiting[i] = (int)children.size();
+		for (auto j = children.begin(); j != children.end(); j++) {
+			parents[*j].push_back(i);
+		}
+	}
+
+	// Placers read the netlist and the macros of other subckts, which
+	// mapToLayout and the stream modify, so they share the lock that those
+	// take exclusively. Under the shared lock a placer writes only its own
+	// macro and reads only the macros of its children. A subckt is dispatched
+	// once all of its children are placed and its parents wait for it, so
+	// no other placer reads the macro being written.
+	std::shared_mutex lock;
+	auto childrenPlaced = [&](int i) {
+		for (auto j = lst.subckts[i].inst.begin(); j != lst.subckts[i].inst.end(); j++) {
+			if (j->subckt != i and not lst.subckts[j->subckt].isCell and not placed[j->subckt]) {
+				return false;
+			}
+		}
+		return true;
+	};
+	ThreadPool pool(jobs);
+	std::function<void(int)> dispatch;
+	dispatch = [&](int i) {
+		pool.push([&, i]() {
+			Timer tmr;
+			int area = 0;
+			{
+				std::shared_lock<std::shared_mutex> reading(lock);
+				assert(childrenPlaced(i) and not placed[i]);
+				sch::Placer placer(lib, lst, 0, 0, false, debug);
+				area = placeSubckt(placer, lib, lst, i);
+			}
+
+			std::unique_lock<std::shared_mutex> guard(lock);
 			if (progress) {
-				printf("  %s...", lst.subckts[i].name.c_str());
+				printf("  %s...[%s%d DBUNIT2 AREA%s]\t%gs\n", lst.subckts[i].name.c_str(), KGRN, area, KNRM, tmr.since());
 				fflush(stdout);
 			}
+			if (stream != nullptr and cells != nullptr) {
+				export_layout(*stream, lib, i, *cells);
+			}
+			lst.mapToLayout(i, lib.macros[i]);
+			placed[i] = true;
+			if (release != nullptr) {
+				release->done(i);
+			}
+
+			for (auto j = parents[i].begin(); j != parents[i].end(); j++) {
+				if (--waiting[*j] == 0) {
+					dispatch(*j);
+				}
+			}
+		});
+	};
+
+	for (int i = 0; i < count; i++) {
+		if (not lst.subckts[i].isCell and waiting[i] == 0) {
+			dispatch(i);
+		}
+	}
+	pool.wait();
+
+	// Anything left over is part of an instantiation cycle, fall back to index
+	// order like the sequential placer.
+	sch::Placer placer(lib, lst, 0, 0, progress, debug);
+	for (int i = 0; i < count; i++) {
+		if (not lst.subckts[i].isCell and not placed[i]) {
 			Timer tmr;
-			lib.macros[i].name = lst.subckts[i].name;
-			placer.place(i);
+			int area = placeSubckt(placer, lib, lst, i);
 			if (progress) {
-				int area = 0;
-				for (auto j = lst.subckts[i].inst.begin(); j != lst.subckts[i].inst.end(); j++) {
-					if (lst.subckts[j->subckt].isCell) {
-						area += lib.macros[j->subckt].box.area();
-					}
-				}
-				printf("[%s%d DBUNIT2 AREA%s]\t%gs\n", KGRN, area, KNRM, tmr.since());
+				printf("  %s...[%s%d DBUNIT2 AREA%s]\t%gs\n", lst.subckts[i].name.c_str(), KGRN, area, KNRM, tmr.since());
 			}
 			if (stream != nullptr and cells != nullptr) {
 				export_layout(*stream, lib, i, *cells);
 			}
 			lst.mapToLayout(i, lib.macros[i]);
+			if (release != nullptr) {
+				release->done(i);
+			}
+		}
+	}
+}
+
+// If release is set, macros that have been written to the stream are dropped
+// from the library once nothing left to place depends on them.
+void doPlacement(phy::Library &lib, sch::Netlist &lst, gdstk::GdsWriter *stream=nullptr, map<int, gdstk::Cell*> *cells=nullptr, bool progress=false, bool debug=false, int jobs=1, bool release=false) {
+	if (progress) {
+		printf("Placing Cells:\n");
+	}
+
+	if (lib.macros.size() < lst.subckts.size()) {
+		lib.macros.resize(lst.subckts.size(), Layout(*lib.tech));
+	}
+
+	std::unique_ptr<Release> tracker;
+	if (release and stream != nullptr and cells != nullptr) {
+		tracker = std::unique_ptr<Release>(new Release(lib, lst, cells));
+	}
+
+	Timer total;
+	if (jobs > 1) {
+		doParallelPlacement(lib, lst, stream, cells, tracker.get(), progress, debug, jobs);
+	} else {
+		sch::Placer placer(lib, lst, 0, 0, progress, debug);
+
+		for (int i = 0; i < (int)lst.subckts.size(); i++) {
+			if (not lst.subckts[i].isCell) {
+				if (progress) {
+					printf("  %s...", lst.subckts[i].name.c_str());
+					fflush(stdout);
+				}
+				Timer tmr;
+				int area = placeSubckt(placer, lib, lst, i);
+				if (progress) {
+					printf("[%s%d DBUNIT2 AREA%s]\t%gs\n", KGRN, area, KNRM, tmr.since());
+				}
+				if (stream != nullptr and cells != nullptr) {
+					export_layout(*stream, lib, i, *cells);
+				}
+				lst.mapToLayout(i, lib.macros[i]);
+				if (tracker) {
+					tracker->done(i);
+				}
+			}
 		}
 	}
 
@@ -121,31 +433,149 @@ void doPlacement(phy::Library &lib, sch::Netlist &lst, gdstk::GdsWriter *stream=
 }
 
 void Build::build(weaver::Program &prgm, weaver::TermId term) {
+	if (jobs > 1) {
+		// Term::getDialect registers missing dialects, which is not thread safe.
+		// Make sure every dialect we lower into exists before dispatching.
+		weaver::Term::getDialect("flow");
+		weaver::Term::getDialect("verilog");
+		weaver::Term::getDialect("circ");
+		weaver::Term::getDialect("spice");
+		weaver::Term::getDialect("layout");
+
+		// When building the whole program, the sequential algorithm picks up the
+		// terms created by each lowering as it walks the growing module list. We
+		// get the same result by scheduling the new terms as they are created.
+		vector<weaver::TermId> terms;
+		if (term.mod < 0) {
+			for (term.mod = 0; term.mod < (int)prgm.mods.size(); term.mod++) {
+				if (not selected(prgm.mods[term.mod].name)) {
+					continue;
+				}
+				for (term.index = 0; term.index < (int)prgm.mods[term.mod].terms.size(); term.index++) {
+					terms.push_back(term);
+				}
+			}
+		} else if (term.index < 0) {
+			for (term.index = 0; term.index < (int)prgm.mods[term.mod].terms.size(); term.index++) {
+				terms.push_back(term);
+			}
+		} else {
+			terms.push_back(term);
+		}
+
+		ThreadPool pool(jobs);
+		schedule(pool, prgm, terms, term.mod < 0);
+		return;
+	}
+
 	if (term.mod < 0) {
 		for (term.mod = 0; term.mod < (int)prgm.mods.size(); term.mod++) {
-			build(prgm, term);
+			if (selected(prgm.mods[term.mod].name)) {
+				build(prgm, term);
+			}
 		}
 	} else if (term.index < 0) {
 		for (term.index = 0; term.index < (int)prgm.mods[term.mod].terms.size(); term.index++) {
 			build(prgm, term);
 		}
 	} else {
-		if (prgm.mods[term.mod].terms[term.index].kind < 0) {
-			printf("internal:%s:%d: dialect not defined for term '%s'\n", __FILE__, __LINE__, prgm.mods[term.mod].terms[term.index].decl.name.c_str());
-			return;
-		}
-		string dialectName = prgm.mods[term.mod].terms[term.index].dialect().name;
-		if (dialectName == "func") {
-			chpToFlow(prgm, term.mod, term.index);
-		} else if (dialectName == "flow") {
-			flowToVerilog(prgm, term.mod, term.index);
-		} else if (dialectName == "proto") {
-			hseToPrs(prgm, term.mod, term.index);
-		} else if (dialectName == "circ") {
-			prsToSpi(prgm, term.mod, term.index);
-		} else if (dialectName == "spice") {
-			spiToGds(prgm, term.mod, term.index);
+		lower(prgm, term);
+	}
+}
+
+// Lower a single term. Each stage reads only the source module and writes
+// only the module derived from it by name, so the parallel build can hand it
+// a program that holds nothing but the source term.
+bool Build::lower(weaver::Program &prgm, weaver::TermId term) {
+	if (prgm.mods[term.mod].terms[term.index].kind < 0) {
+		printf("internal:%s:%d: dialect not defined for term '%s'\n", __FILE__, __LINE__, prgm.mods[term.mod].terms[term.index].decl.name.c_str());
+		return false;
+	}
+	string dialectName = prgm.mods[term.mod].terms[term.index].dialect().name;
+	if (dialectName == "func") {
+		return chpToFlow(prgm, term.mod, term.index);
+	} else if (dialectName == "flow") {
+		return flowToVerilog(prgm, term.mod, term.index);
+	} else if (dialectName == "proto") {
+		return hseToPrs(prgm, term.mod, term.index);
+	} else if (dialectName == "circ") {
+		return prsToSpi(prgm, term.mod, term.index);
+	} else if (dialectName == "spice") {
+		return spiToGds(prgm, term.mod, term.index);
+	}
+	return true;
+}
+
+// Lower terms on the thread pool in waves. The lowering functions create
+// modules and terms as they go, which would invalidate references held by
+// other workers. So each task lowers its term inside a private program that
+// only contains the source module, and the results are merged back into prgm
+// in the order of terms once the wave has finished. This keeps module and
+// term indices independent of which worker finishes first. If chain is set,
+// the terms created by one wave are lowered by the next.
+void Build::schedule(ThreadPool &pool, weaver::Program &prgm, vector<weaver::TermId> terms, bool chain) {
+	while (not terms.empty()) {
+		vector<weaver::Program> local(terms.size());
+		vector<weaver::TermId> src(terms.size(), weaver::TermId());
+		for (int i = 0; i < (int)terms.size(); i++) {
+			weaver::Term &orig = prgm.termAt(terms[i]);
+			if (orig.kind < 0) {
+				printf("internal:%s:%d: dialect not defined for term '%s'\n", __FILE__, __LINE__, orig.decl.name.c_str());
+				continue;
+			}
+
+			src[i].mod = local[i].getModule(prgm.mods[terms[i].mod].name);
+			src[i].index = local[i].mods[src[i].mod].createTerm(weaver::Term::procOf(orig.kind, orig.decl.name, orig.decl.args, orig.decl.ret, orig.decl.recv));
+			local[i].mods[src[i].mod].terms[src[i].index].def = std::move(orig.def);
+		}
+
+		// The libraries count errors in unsynchronized globals, so increments
+		// from several workers at once can be lost. Each task also records
+		// whether its lowering failed, and the count is settled after the join.
+		int errors = num_errors;
+		vector<int> failed(terms.size(), 0);
+		for (int i = 0; i < (int)terms.size(); i++) {
+			if (src[i].mod >= 0) {
+				pool.push([this, &local, &src, &failed, i]() {
+					failed[i] = not lower(local[i], src[i]);
+				});
+			}
 		}
+		pool.wait();
+
+		int failures = 0;
+		vector<weaver::TermId> created;
+		for (int k = 0; k < (int)terms.size(); k++) {
+			if (src[k].mod < 0) {
+				continue;
+			}
+			failures += failed[k];
+
+			// lowering may modify the source term in place (elaboration, sizing, ...)
+			prgm.termAt(terms[k]).def = std::move(local[k].mods[src[k].mod].terms[src[k].index].def);
+
+			for (int i = 0; i < (int)local[k].mods.size(); i++) {
+				for (int j = 0; j < (int)local[k].mods[i].terms.size(); j++) {
+					if (i == src[k].mod and j == src[k].index) {
+						continue;
+					}
+
+					weaver::Term &result = local[k].mods[i].terms[j];
+					int modIdx = prgm.getModule(local[k].mods[i].name);
+					int termIdx = prgm.mods[modIdx].createTerm(weaver::Term::procOf(result.kind, result.decl.name, result.decl.args, result.decl.ret, result.decl.recv));
+					prgm.mods[modIdx].terms[termIdx].def = std::move(result.def);
+					created.push_back(weaver::TermId(modIdx, termIdx));
+				}
+			}
+		}
+		if (num_errors < errors + failures) {
+			num_errors = errors + failures;
+		}
+
+		if (not chain) {
+			break;
+		}
+		terms = created;
 	}
 }
 
@@ -321,10 +751,32 @@ bool Build::hseToPrs(weaver::Program &prgm, int modIdx, int termIdx) const {
 	hg.post_process(true);
 	hg.check_variables();
 
+	string key;
+	if (get(Build::RULES) and cacheable(Build::ELAB, Build::RULES)) {
+		key = cacheKey("hseToPrs", hse::export_astg(hg).to_string(), false);
+		std::any def;
+		Stage prof(profile, prgm.mods[modIdx].name, name, "CACHE");
+		std::any src;
+		if (cache.has(key)
+			and cache.load(key, "proto", name, src)
+			and cache.load(key, "circ", name, def)) {
+			if (progress) printf("Load production rules for %s from cache\n\n", name.c_str());
+			prof.metric("hit", 1);
+			// elaboration and encoding modify the input, it is saved alongside
+			prgm.mods[modIdx].terms[termIdx].def = std::move(src);
+			int dstIdx = prgm.mods[cktIdx].createTerm(weaver::Term::procOf(cktKind, name, args));
+			prgm.mods[cktIdx].terms[dstIdx].def = std::move(def);
+			return true;
+		}
+	}
+
 	if (get(Build::ELAB)) {
+		Stage prof(profile, prgm.mods[modIdx].name, name, "ELAB");
 		if (progress) printf("Elaborate state space:\n");
 		hse::elaborate(hg, stage >= Build::ENCODE or not noGhosts, true, progress);
 		if (progress) printf("done\n\n");
+		prof.metric("places", hg.places.size());
+		prof.metric("transitions", hg.transitions.size());
 
 		if (has(Build::ELAB)) {
 			std::filesystem::create_directories(debugDir);
@@ -346,9 +798,11 @@ bool Build::hseToPrs(weaver::Program &prgm, int modIdx, int termIdx) const {
 	hse::encoder enc;
 	enc.base = &hg;
 	if (get(Build::CONFLICTS)) {
+		Stage prof(profile, prgm.mods[modIdx].name, name, "CONFLICTS");
 		if (progress) printf("Identify state conflicts:\n");
 		enc.check(!inverting, progress);
 		if (progress) printf("done\n\n");
+		prof.metric("conflicts", enc.conflicts.size());
 
 		if (has(Build::CONFLICTS)) {
 			print_conflicts(enc);
@@ -356,11 +810,15 @@ bool Build::hseToPrs(weaver::Program &prgm, int modIdx, int termIdx) const {
 	}
 
 	if (get(Build::ENCODE)) {
+		Stage prof(profile, prgm.mods[modIdx].name, name, "ENCODE");
 		if (progress) printf("Insert state variables:\n");
 		if (not enc.insert_state_variables(20, !inverting, progress, debug)) {
 			return false;
 		}
 		if (progress) printf("done\n\n");
+		prof.metric("places", hg.places.size());
+		prof.metric("transitions", hg.transitions.size());
+		prof.metric("conflicts", enc.conflicts.size());
 
 		if (has(Build::ENCODE)) {
 			string suffix = stage == Build::ENCODE ? "" : "_complete";
@@ -375,13 +833,20 @@ bool Build::hseToPrs(weaver::Program &prgm, int modIdx, int termIdx) const {
 	}
 
 	if (get(Build::RULES)) {
+		Stage prof(profile, prgm.mods[modIdx].name, name, "RULES");
 		if (progress) printf("Synthesize production rules:\n");
 		prs::production_rule_set pr;
 		hse::synthesize_rules(&pr, &hg, !inverting, progress);
 		if (progress) printf("done\n\n");
+		prof.metric("rules", pr.devs.size());
+		prof.metric("nets", pr.nets.size());
 
 		int dstIdx = prgm.mods[cktIdx].createTerm(weaver::Term::procOf(cktKind, name, args));
 		prgm.mods[cktIdx].terms[dstIdx].def = pr;
+
+		if (not key.empty() and is_clean()) {
+			cache.save(key, prgm, {weaver::TermId(modIdx, termIdx), weaver::TermId(cktIdx, dstIdx)});
+		}
 	}
 	return true;
 }
@@ -410,12 +875,33 @@ bool Build::prsToSpi(weaver::Program &prgm, int modIdx, int termIdx) {
 
 	prs::production_rule_set &pr = prgm.mods[modIdx].terms[termIdx].as<prs::production_rule_set>();
 
+	string key;
+	if (cacheable(Build::BUBBLE, Build::NETS)) {
+		key = cacheKey("prsToSpi", prs::export_production_rule_set(pr).to_string(), get(Build::NETS));
+		std::any src, dst;
+		Stage prof(profile, prgm.mods[modIdx].name, name, "CACHE");
+		if (cache.has(key)
+			and cache.load(key, "circ", name, src)
+			and (not get(Build::NETS) or cache.load(key, "spice", name, dst))) {
+			if (progress) printf("Load netlist for %s from cache\n\n", name.c_str());
+			prof.metric("hit", 1);
+			// the sized production rules are saved alongside the netlist
+			prgm.mods[modIdx].terms[termIdx].def = std::move(src);
+			if (get(Build::NETS)) {
+				int dstIdx = prgm.mods[spiIdx].createTerm(weaver::Term::procOf(spiKind, name, args));
+				prgm.mods[spiIdx].terms[dstIdx].def = std::move(dst);
+			}
+			return true;
+		}
+	}
+
 	bool inverting = false;
 	if (logic == Build::LOGIC_CMOS) {
 		inverting = true;
 	}
 
 	if (get(Build::BUBBLE) and inverting and not pr.cmos_implementable()) {
+		Stage prof(profile, prgm.mods[modIdx].name, name, "BUBBLE");
 		if (progress) {
 			printf("Bubble reshuffle production rules:\n");
 			printf("  %s...", pr.name.c_str());
@@ -442,6 +928,7 @@ bool Build::prsToSpi(weaver::Program &prgm, int modIdx, int termIdx) {
 		//}
 
 		bub.save_prs(&pr);
+		prof.metric("rules", pr.devs.size());
 		if (progress) {
 			printf("[%sDONE%s]\n", KGRN, KNRM);
 			printf("done\n\n");
@@ -450,34 +937,46 @@ bool Build::prsToSpi(weaver::Program &prgm, int modIdx, int termIdx) {
 
 	if (get(Build::KEEPERS)) {
 		if (logic == Build::LOGIC_CMOS or logic == Build::LOGIC_RAW) {
+			Stage prof(profile, prgm.mods[modIdx].name, name, "KEEPERS");
 			if (progress) printf("Insert keepers:\n");
 			pr.add_keepers(true, false, 1, progress);
 			if (progress) printf("done\n\n");
+			prof.metric("rules", pr.devs.size());
 		}
 	}
 
 	if (get(Build::SIZE)) {
+		Stage prof(profile, prgm.mods[modIdx].name, name, "SIZE");
 		if (progress) printf("Size production rules:\n");
 		pr.size_devices(0.1, progress);
 		if (progress) printf("done\n\n");
+		prof.metric("rules", pr.devs.size());
 	}
 	
 	if (get(Build::NETS)) {
-		if (not proj.tech.isLoaded() and not phy::loadTech(proj.tech)) {
-			cout << "Unable to load techfile \'" + proj.tech.path + "\'." << endl;
+		if (not proj.loadTech()) {
 			return false;
 		}
 
+		Stage prof(profile, prgm.mods[modIdx].name, name, "NETS");
 		sch::Netlist net;
 		if (progress) printf("Build netlist:\n");
 		net.subckts.push_back(prs::build_netlist(proj.tech, pr, progress));
 		if (progress) printf("done\n\n");
+		prof.metric("devices", net.subckts.back().mos.size());
+		prof.metric("nets", net.subckts.back().nets.size());
 		if (debug) {
 			net.subckts.back().print();
 		}
 
 		int dstIdx = prgm.mods[spiIdx].createTerm(weaver::Term::procOf(spiKind, name, args));
 		prgm.mods[spiIdx].terms[dstIdx].def = net;
+
+		if (not key.empty() and is_clean()) {
+			cache.save(key, prgm, {weaver::TermId(modIdx, termIdx), weaver::TermId(spiIdx, dstIdx)});
+		}
+	} else if (not key.empty() and is_clean()) {
+		cache.save(key, prgm, {weaver::TermId(modIdx, termIdx)});
 	}
 	return true;
 }
@@ -515,30 +1014,102 @@ bool Build::spiToGds(weaver::Program &prgm, int modIdx, int termIdx) {
 		}
 	}
 
-	if (not proj.tech.isLoaded() and not phy::loadTech(proj.tech)) {
-		cout << "Unable to load techfile \'" + proj.tech.path + "\'." << endl;
+	if (not proj.loadTech()) {
 		return false;
 	}
 
 	Timer cellsTmr;
 	if (get(Build::MAP)) {
+		Stage prof(profile, prgm.mods[modIdx].name, name, "MAP");
 		if (progress) printf("Break subckts into cells:\n");
 		net.mapCells(proj.tech, progress);
 		if (progress) printf("done\t%gs\n\n", cellsTmr.since());
+		prof.metric("subckts", net.subckts.size());
+		prof.metric("cells", countSubckts(net, true));
+	}
+
+	// The key is taken after mapping so that it only covers the cells this
+	// netlist uses.
+	string key;
+	string input;
+	if (cacheable(Build::MAP, Build::PLACE) and not stream) {
+		input = sch::export_netlist(proj.tech, net).to_string();
+		key = cacheKey("spiToGds", input, true, cellNames(net));
+		std::any src, dst;
+		Stage prof(profile, prgm.mods[modIdx].name, name, "CACHE");
+		if (cache.has(key)
+			and cache.load(key, "spice", name, src)
+			and cache.load(key, "layout", name, dst)) {
+			if (progress) printf("Load layout for %s from cache\n\n", name.c_str());
+			prof.metric("hit", 1);
+			// the placed netlist is saved alongside the layout
+			prgm.mods[modIdx].terms[termIdx].def = std::move(src);
+			int dstIdx = prgm.mods[gdsIdx].createTerm(weaver::Term::procOf(gdsKind, name, args));
+			prgm.mods[gdsIdx].terms[dstIdx].def = std::move(dst);
+			return true;
+		}
 	}
 
 	phy::Library lib(proj.tech);
 	map<int, gdstk::Cell*> cells;
+
+	// Write the layout as it is generated rather than holding the whole
+	// library until the program is saved.
+	fs::path streamPath;
+	gdstk::GdsWriter writer = {};
+	gdstk::GdsWriter *gds = nullptr;
+	if (stream and (get(Build::CELLS) or get(Build::PLACE))) {
+		streamPath = proj.emitPath("layout", prgm.mods[gdsIdx].name, name);
+		if (not streamPath.empty()) {
+			fs::create_directories(streamPath.parent_path());
+			string pathstr = streamPath.string();
+			writer = gdstk::gdswriter_init(pathstr.c_str(), name.c_str(), ((double)proj.tech.dbunit)*1e-6, ((double)proj.tech.dbunit)*1e-6, 4, nullptr, nullptr);
+			gds = &writer;
+		}
+	}
+
+	// Terms are already lowered in parallel when building with several jobs,
+	// so only use them here when this term has the machine to itself.
+	int inner = ThreadPool::working() ? 1 : jobs;
+
 	if (get(Build::CELLS)) {
-		cell::update_library(lib, net, nullptr, &cells, progress, debug);
+		Stage prof(profile, prgm.mods[modIdx].name, name, "CELLS");
+		cell::update_library(lib, net, gds, &cells, progress, debug, inner);
+		prof.metric("cells", countSubckts(net, true));
+		prof.metric("area", countArea(lib, net, true));
 	}
 
 	if (get(Build::PLACE)) {
-		doPlacement(lib, net, nullptr, &cells, progress, debug);
+		Stage prof(profile, prgm.mods[modIdx].name, name, "PLACE");
+		doPlacement(lib, net, gds, &cells, progress, debug, inner, gds != nullptr);
+		prof.metric("subckts", countSubckts(net, false));
+		if (gds == nullptr) {
+			// the macros have been released when streaming
+			prof.metric("area", countArea(lib, net, false));
+		}
+	}
+
+	if (gds != nullptr) {
+		writer.close();
+		proj.setStreamed(streamPath);
+		for (auto cell = cells.begin(); cell != cells.end(); cell++) {
+			freeCell(cell->second);
+		}
+		cells.clear();
+		// The macros were released as they were written, so the term is left
+		// empty. setStreamed records that its layout lives in streamPath.
+		lib.macros.clear();
 	}
 
 	int dstIdx = prgm.mods[gdsIdx].createTerm(weaver::Term::procOf(gdsKind, name, args));
 	prgm.mods[gdsIdx].terms[dstIdx].def = lib;
+
+	if (not key.empty() and is_clean()) {
+		// cells that were missing have been generated into the library since
+		// the lookup, save under the key the next build will look for
+		key = cacheKey("spiToGds", input, true, cellNames(net));
+		cache.save(key, prgm, {weaver::TermId(modIdx, termIdx), weaver::TermId(gdsIdx, dstIdx)});
+	}
 	return true;
 }
 
@@ -7,6 +7,11 @@
 #include <phy/Tech.h>
 
 #include "project.h"
+#include "pool.h"
+#include "cache.h"
+#include "profile.h"
+
+#include <set>
 
 struct Build {
 	Build(weaver::Project &proj);
@@ -50,13 +55,26 @@ struct Build {
 
 	bool noCells;
 	bool noGhosts;
+	bool noCache;
+	// write layouts as they are placed instead of holding them in memory
+	bool stream;
 
 	bool progress;
 	bool debug;
 	bool format_expressions_as_html_table;
+
+	// number of worker threads, terms are lowered sequentially if this is 1
+	int jobs;
+	// records the cost of each stage when set
+	Profile *profile;
+	// when building the whole program, only lower the terms of these modules
+	// and the modules derived from them. Every module is lowered if empty.
+	std::set<string> only;
 	
 	vector<bool> targets;
 
+	weaver::Cache cache;
+
 	void set(int target);
 	bool get(int target) const;
 
@@ -65,7 +83,14 @@ struct Build {
 	void excl(int target);
 	bool has(int target) const;
 
+	bool selected(string mod) const;
+	bool cacheable(int from, int to) const;
+	// cells are the library cells whose layouts the result is made of
+	string cacheKey(string lowering, string input, bool useTech, const vector<string> &cells=vector<string>()) const;
+
 	void build(weaver::Program &prgm, weaver::TermId term=weaver::TermId());
+	bool lower(weaver::Program &prgm, weaver::TermId term);
+	void schedule(ThreadPool &pool, weaver::Program &prgm, vector<weaver::TermId> terms, bool chain);
 
 	// TODO(edward.bingham) generalize this into lowering and analysis stages, create a DAG to generalize the compilation algorithm
 	bool chpToFlow(weaver::Program &prgm, int modIdx, int termIdx) const;
@@ -0,0 +1,108 @@
+#include "cache.h"
+#include "mapped.h"
+
+#include <thread>
+#include <unistd.h>
+
+namespace weaver {
+
+// A dialect may be read from several formats, entries are stored in the
+// first one that can be both written and loaded.
+static const Filetype *storable(const Project &proj, string dialect) {
+	for (auto i = proj.filetypes.begin(); i != proj.filetypes.end(); i++) {
+		if (i->dialect == dialect and i->write != nullptr and i->load != nullptr) {
+			return &(*i);
+		}
+	}
+	return nullptr;
+}
+
+Cache::Cache(Project &proj) : proj(proj) {
+}
+
+Cache::~Cache() {
+}
+
+fs::path Cache::dir() const {
+	return proj.rootDir / Project::BUILD / "cache";
+}
+
+bool Cache::has(string key) const {
+	return fs::exists(dir() / key);
+}
+
+bool Cache::load(string key, string dialect, string name, std::any &def) const {
+	const Filetype *filetype = storable(proj, dialect);
+	if (filetype == nullptr) {
+		return false;
+	}
+
+	fs::path path = dir() / key / (name + "." + filetype->ext);
+	if (not fs::exists(path)) {
+		return false;
+	}
+
+	Source source;
+	source.path = path;
+	source.modName = dialect;
+	source.filetype = filetype;
+	source.tokens = shared_ptr<tokenizer>(new tokenizer());
+
+	if (filetype->read != nullptr) {
+		MappedFile file;
+		if (not file.open(path)) {
+			return false;
+		}
+
+		filetype->read(proj, source, file.view());
+		if (source.syntax == nullptr) {
+			return false;
+		}
+	}
+
+	Program local;
+	filetype->load(proj, local, source);
+	if (local.mods.empty() or local.mods[0].terms.empty()) {
+		return false;
+	}
+
+	def = std::move(local.mods[0].terms[0].def);
+	return true;
+}
+
+bool Cache::save(string key, const Program &prgm, vector<TermId> terms) const {
+	fs::path entry = dir() / key;
+	if (fs::exists(entry)) {
+		return true;
+	}
+
+	// Several workers, or several processes, may produce the same entry at
+	// once. Write into a private directory and move it into place.
+	size_t self = std::hash<std::thread::id>()(std::this_thread::get_id());
+	fs::path tmp = dir() / (key + ".tmp" + std::to_string((int)getpid()) + "_" + std::to_string(self));
+
+	std::error_code ec;
+	fs::create_directories(tmp, ec);
+	if (ec) {
+		return false;
+	}
+
+	for (auto i = terms.begin(); i != terms.end(); i++) {
+		const Term &term = prgm.mods[i->mod].terms[i->index];
+		const Filetype *filetype = storable(proj, term.dialect().name);
+		if (filetype == nullptr) {
+			fs::remove_all(tmp, ec);
+			return false;
+		}
+		filetype->write(tmp / (term.decl.name + "." + filetype->ext), proj, prgm, i->mod, i->index);
+	}
+
+	fs::rename(tmp, entry, ec);
+	if (ec) {
+		fs::remove_all(tmp, ec);
+		return fs::exists(entry);
+	}
+	return true;
+}
+
+}
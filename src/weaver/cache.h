@@ -0,0 +1,32 @@
+#pragma once
+
+#include <common/standard.h>
+#include <weaver/program.h>
+
+#include <any>
+
+#include "project.h"
+
+namespace weaver {
+
+// A content-addressed store for the results of the lowering stages. Each
+// entry is a directory under build/cache named by the hash of everything that
+// determines the result. Terms are stored in the format of their dialect's
+// Filetype, so an entry can be inspected like any other build output.
+struct Cache {
+	Cache(Project &proj);
+	~Cache();
+
+	Project &proj;
+
+	fs::path dir() const;
+	bool has(string key) const;
+
+	// Read the term with the given dialect and name from the entry into def.
+	bool load(string key, string dialect, string name, std::any &def) const;
+	// Write the terms into a new entry. The entry only becomes visible once
+	// every term has been written.
+	bool save(string key, const Program &prgm, vector<TermId> terms) const;
+};
+
+}
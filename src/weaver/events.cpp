@@ -0,0 +1,86 @@
+#include "events.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+Delay::Delay() {
+	kind = FIXED;
+	a = 0.0;
+	b = 0.0;
+}
+
+Delay::Delay(double value) {
+	kind = FIXED;
+	a = value;
+	b = 0.0;
+}
+
+Delay::~Delay() {
+}
+
+bool Delay::parse(string spec) {
+	string name = "fixed";
+	size_t colon = spec.find(':');
+	if (colon != string::npos) {
+		name = spec.substr(0, colon);
+		spec = spec.substr(colon+1);
+	}
+
+	size_t comma = spec.find(',');
+	string first = spec.substr(0, comma);
+	string second = comma == string::npos ? "" : spec.substr(comma+1);
+
+	char *end = nullptr;
+	a = strtod(first.c_str(), &end);
+	if (first.empty() or *end != '\0' or a < 0.0) {
+		return false;
+	}
+	b = 0.0;
+
+	if (name == "fixed" or name == "exp") {
+		kind = name == "fixed" ? FIXED : EXPONENTIAL;
+		return second.empty();
+	}
+
+	b = strtod(second.c_str(), &end);
+	if (second.empty() or *end != '\0' or b < 0.0) {
+		return false;
+	}
+
+	if (name == "uniform") {
+		kind = UNIFORM;
+		return a <= b;
+	} else if (name == "normal") {
+		kind = NORMAL;
+		return true;
+	}
+	return false;
+}
+
+uint64_t Delay::sample(std::mt19937_64 &rng) const {
+	double result = a;
+	if (kind == UNIFORM) {
+		result = std::uniform_real_distribution<double>(a, b)(rng);
+	} else if (kind == NORMAL and b > 0.0) {
+		result = std::normal_distribution<double>(a, b)(rng);
+	} else if (kind == EXPONENTIAL and a > 0.0) {
+		result = std::exponential_distribution<double>(1.0/a)(rng);
+	}
+	// time never runs backwards
+	return result <= 0.0 ? 0 : (uint64_t)std::llround(result);
+}
+
+string Delay::to_string() const {
+	char buffer[128];
+	if (kind == UNIFORM) {
+		snprintf(buffer, sizeof(buffer), "uniform:%g,%g", a, b);
+	} else if (kind == NORMAL) {
+		snprintf(buffer, sizeof(buffer), "normal:%g,%g", a, b);
+	} else if (kind == EXPONENTIAL) {
+		snprintf(buffer, sizeof(buffer), "exp:%g", a);
+	} else {
+		snprintf(buffer, sizeof(buffer), "fixed:%g", a);
+	}
+	return string(buffer);
+}
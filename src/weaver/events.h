@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <queue>
+#include <random>
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+// The delay of a transition in ps, drawn from a distribution. Written as
+// "<t>" or "fixed:<t>", "uniform:<lo>,<hi>", "normal:<mean>,<stddev>" or
+// "exp:<mean>".
+struct Delay {
+	enum {
+		FIXED = 0,
+		UNIFORM = 1,
+		NORMAL = 2,
+		EXPONENTIAL = 3
+	};
+
+	Delay();
+	Delay(double value);
+	~Delay();
+
+	int kind;
+	double a;
+	double b;
+
+	bool parse(string spec);
+	uint64_t sample(std::mt19937_64 &rng) const;
+	string to_string() const;
+};
+
+// Pending events ordered by time, ties are broken in the order they were
+// scheduled. A key has at most one pending event. Rescheduling or cancelling
+// a key leaves its old entry in the heap, where it is skipped when popped.
+template <typename Key>
+struct EventQueue {
+	struct Event {
+		uint64_t at;
+		uint64_t seq;
+		Key key;
+
+		bool operator>(const Event &e) const {
+			return at > e.at or (at == e.at and seq > e.seq);
+		}
+	};
+
+	std::priority_queue<Event, vector<Event>, std::greater<Event> > heap;
+	// the time and sequence number of the live event for each key
+	std::map<Key, std::pair<uint64_t, uint64_t> > pending;
+	uint64_t next = 0;
+
+	void schedule(Key key, uint64_t at) {
+		pending[key] = std::pair<uint64_t, uint64_t>(at, next);
+		heap.push(Event{at, next, key});
+		next++;
+	}
+
+	bool has(const Key &key) const {
+		return pending.find(key) != pending.end();
+	}
+
+	void cancel(const Key &key) {
+		pending.erase(key);
+	}
+
+	// Remove the earliest live event, returns false if there are none
+	bool pop(Key &key, uint64_t &at) {
+		while (not heap.empty()) {
+			Event e = heap.top();
+			heap.pop();
+			auto pos = pending.find(e.key);
+			if (pos != pending.end() and pos->second.second == e.seq) {
+				pending.erase(pos);
+				key = e.key;
+				at = e.at;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool empty() const {
+		return pending.empty();
+	}
+
+	void clear() {
+		heap = std::priority_queue<Event, vector<Event>, std::greater<Event> >();
+		pending.clear();
+	}
+};
@@ -0,0 +1,56 @@
+#include "hash.h"
+
+#include <cstdio>
+
+Hasher::Hasher() {
+	value = 14695981039346656037ull;
+}
+
+Hasher::~Hasher() {
+}
+
+Hasher &Hasher::add(const void *data, size_t size) {
+	const unsigned char *bytes = (const unsigned char *)data;
+	for (size_t i = 0; i < size; i++) {
+		value ^= bytes[i];
+		value *= 1099511628211ull;
+	}
+	return *this;
+}
+
+Hasher &Hasher::add(string str) {
+	add((int64_t)str.size());
+	return add(str.data(), str.size());
+}
+
+Hasher &Hasher::add(int64_t num) {
+	unsigned char bytes[8];
+	for (int i = 0; i < 8; i++) {
+		bytes[i] = (unsigned char)(((uint64_t)num >> (8*i)) & 0xFF);
+	}
+	return add(bytes, 8);
+}
+
+bool Hasher::addFile(std::filesystem::path path) {
+	FILE *fptr = fopen(path.string().c_str(), "rb");
+	if (fptr == nullptr) {
+		return false;
+	}
+
+	char buffer[65536];
+	size_t count = 0;
+	int64_t total = 0;
+	while ((count = fread(buffer, 1, sizeof(buffer), fptr)) > 0) {
+		add(buffer, count);
+		total += (int64_t)count;
+	}
+	fclose(fptr);
+	add(total);
+	return true;
+}
+
+string Hasher::to_string() const {
+	char buffer[17];
+	snprintf(buffer, sizeof(buffer), "%016llx", (unsigned long long)value);
+	return string(buffer);
+}
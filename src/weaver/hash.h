@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <filesystem>
+
+using std::string;
+
+// 64-bit FNV-1a digest used to content-address build artifacts. This is not
+// a cryptographic hash, it only has to tell apart the inputs of one project.
+struct Hasher {
+	Hasher();
+	~Hasher();
+
+	uint64_t value;
+
+	Hasher &add(const void *data, size_t size);
+	// strings are length-prefixed so that ("ab","c") and ("a","bc") differ
+	Hasher &add(string str);
+	Hasher &add(int64_t num);
+	// Hash the contents of the file, returns false if it could not be read
+	bool addFile(std::filesystem::path path);
+
+	string to_string() const;
+};
@@ -0,0 +1,144 @@
+#include "lanes.h"
+
+#include <algorithm>
+#include <bit>
+
+LaneSim::LaneSim() {
+	nets = 0;
+	vectors = 0;
+	words = 0;
+}
+
+LaneSim::LaneSim(int nets, int vectors) {
+	this->nets = nets;
+	this->vectors = vectors;
+	this->words = (vectors+63)/64;
+
+	high.assign(nets*words, 0);
+	low.assign(nets*words, 0);
+	driven.assign(nets, false);
+	conflict.assign(words, 0);
+	unstable.assign(words, 0);
+	up.assign(nets*words, 0);
+	down.assign(nets*words, 0);
+	changed.assign(words, 0);
+	term.assign(words, 0);
+}
+
+LaneSim::~LaneSim() {
+}
+
+void LaneSim::addRule(LaneRule rule) {
+	if (rule.out < 0 or rule.out >= nets) {
+		return;
+	}
+	driven[rule.out] = true;
+	rules.push_back(rule);
+}
+
+int LaneSim::get(int net, int lane) const {
+	uint64_t bit = (uint64_t)1 << (lane%64);
+	int w = net*words + lane/64;
+	if (high[w] & bit) {
+		return 1;
+	} else if (low[w] & bit) {
+		return 0;
+	}
+	return -1;
+}
+
+void LaneSim::set(int net, int lane, int value) {
+	uint64_t bit = (uint64_t)1 << (lane%64);
+	int w = net*words + lane/64;
+	high[w] &= ~bit;
+	low[w] &= ~bit;
+	if (value == 1) {
+		high[w] |= bit;
+	} else if (value == 0) {
+		low[w] |= bit;
+	}
+}
+
+void LaneSim::randomize(std::mt19937_64 &rng) {
+	// lanes past vectors in the last word are left unknown
+	uint64_t last = vectors%64 == 0 ? ~(uint64_t)0 : (((uint64_t)1 << (vectors%64)) - 1);
+	for (int n = 0; n < nets; n++) {
+		if (driven[n]) {
+			continue;
+		}
+		for (int w = 0; w < words; w++) {
+			uint64_t mask = w == words-1 ? last : ~(uint64_t)0;
+			uint64_t value = rng() & mask;
+			high[n*words + w] = value;
+			low[n*words + w] = ~value & mask;
+		}
+	}
+}
+
+bool LaneSim::step() {
+	std::fill(up.begin(), up.end(), 0);
+	std::fill(down.begin(), down.end(), 0);
+
+	for (auto r = rules.begin(); r != rules.end(); r++) {
+		uint64_t *drive = (r->value == 1 ? up.data() : down.data()) + r->out*words;
+		for (auto t = r->terms.begin(); t != r->terms.end(); t++) {
+			std::fill(term.begin(), term.end(), ~(uint64_t)0);
+			for (auto l = t->begin(); l != t->end(); l++) {
+				const uint64_t *plane = ((*l & 1) ? low.data() : high.data()) + (*l >> 1)*words;
+				for (int w = 0; w < words; w++) {
+					term[w] &= plane[w];
+				}
+			}
+			for (int w = 0; w < words; w++) {
+				drive[w] |= term[w];
+			}
+		}
+	}
+
+	std::fill(changed.begin(), changed.end(), 0);
+	for (int n = 0; n < nets; n++) {
+		if (not driven[n]) {
+			continue;
+		}
+		uint64_t *h = high.data() + n*words;
+		uint64_t *l = low.data() + n*words;
+		const uint64_t *u = up.data() + n*words;
+		const uint64_t *d = down.data() + n*words;
+		for (int w = 0; w < words; w++) {
+			uint64_t hold = ~(u[w] | d[w]);
+			uint64_t nh = (u[w] & ~d[w]) | (h[w] & hold);
+			uint64_t nl = (d[w] & ~u[w]) | (l[w] & hold);
+			conflict[w] |= u[w] & d[w];
+			changed[w] |= (nh ^ h[w]) | (nl ^ l[w]);
+			h[w] = nh;
+			l[w] = nl;
+		}
+	}
+
+	for (int w = 0; w < words; w++) {
+		if (changed[w] != 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+int LaneSim::settle(int limit) {
+	for (int i = 0; i < limit; i++) {
+		if (not step()) {
+			return i;
+		}
+	}
+	for (int w = 0; w < words; w++) {
+		unstable[w] |= changed[w];
+	}
+	return limit;
+}
+
+int LaneSim::count(const vector<uint64_t> &mask) const {
+	int result = 0;
+	for (auto w = mask.begin(); w != mask.end(); w++) {
+		result += std::popcount(*w);
+	}
+	return result;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+using std::vector;
+
+// A production rule in sum of products form. The net out is driven to value
+// in every lane where all of the literals of at least one term are true. A
+// literal is (net << 1) | 1 for ~net and (net << 1) for net.
+struct LaneRule {
+	int out;
+	int value;
+	vector<vector<int> > terms;
+};
+
+// Simulates many independent copies of a circuit at once, one per bit lane.
+// Every net is stored as two bit planes, the lanes where it is 1 and the
+// lanes where it is 0, so a lane with neither bit set is unknown. Guards are
+// evaluated for all lanes with bitwise operations over the words of a net,
+// which are contiguous so the loops vectorize.
+struct LaneSim {
+	LaneSim();
+	LaneSim(int nets, int vectors);
+	~LaneSim();
+
+	int nets;
+	int vectors;
+	// the number of 64 bit words per net
+	int words;
+
+	vector<uint64_t> high;
+	vector<uint64_t> low;
+	vector<LaneRule> rules;
+	// nets with at least one rule, everything else is an input
+	vector<bool> driven;
+
+	// lanes where a net was driven both ways, or that had not settled
+	vector<uint64_t> conflict;
+	vector<uint64_t> unstable;
+
+	void addRule(LaneRule rule);
+
+	// -1 for unknown
+	int get(int net, int lane) const;
+	void set(int net, int lane, int value);
+	// Give every input a random value in every lane
+	void randomize(std::mt19937_64 &rng);
+
+	// Update every driven net once from the current values (unit delay),
+	// returns whether any lane changed. A net driven both ways becomes
+	// unknown, and a net with no active rule keeps its value.
+	bool step();
+	// Step until nothing changes (zero delay), returns the number of steps.
+	// Lanes still changing after limit steps are marked unstable.
+	int settle(int limit);
+
+	// the number of lanes set in the mask
+	int count(const vector<uint64_t> &mask) const;
+
+private:
+	vector<uint64_t> up;
+	vector<uint64_t> down;
+	vector<uint64_t> changed;
+	vector<uint64_t> term;
+};
@@ -0,0 +1,85 @@
+#include "mapped.h"
+
+#include <fstream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile() {
+	data = "";
+	size = 0;
+	mapping = nullptr;
+}
+
+MappedFile::~MappedFile() {
+	close();
+}
+
+bool MappedFile::open(std::filesystem::path path) {
+	close();
+
+	std::string pathstr = path.string();
+#ifndef _WIN32
+	int fd = ::open(pathstr.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+
+	struct stat info;
+	if (fstat(fd, &info) == 0 and S_ISREG(info.st_mode)) {
+		if (info.st_size == 0) {
+			::close(fd);
+			return true;
+		}
+
+		void *addr = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (addr != MAP_FAILED) {
+			::close(fd);
+			madvise(addr, (size_t)info.st_size, MADV_SEQUENTIAL);
+			mapping = addr;
+			data = (const char *)addr;
+			size = (size_t)info.st_size;
+			return true;
+		}
+	}
+	::close(fd);
+#endif
+
+	std::ifstream fin(pathstr.c_str(), std::ios::binary | std::ios::in);
+	if (not fin.is_open()) {
+		return false;
+	}
+
+	fin.seekg(0, std::ios::end);
+	std::streamoff length = fin.tellg();
+	if (length < 0) {
+		return false;
+	}
+	buffer.resize((size_t)length);
+	fin.seekg(0, std::ios::beg);
+	fin.read(&buffer[0], length);
+	data = buffer.data();
+	size = buffer.size();
+	return true;
+}
+
+void MappedFile::close() {
+#ifndef _WIN32
+	if (mapping != nullptr) {
+		munmap(mapping, size);
+	}
+#endif
+	mapping = nullptr;
+	buffer.clear();
+	buffer.shrink_to_fit();
+	data = "";
+	size = 0;
+}
+
+std::string_view MappedFile::view() const {
+	return std::string_view(data, size);
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <filesystem>
+
+// A read-only view of the contents of a file. The file is memory-mapped where
+// the platform supports it, which saves the copies made while reading it.
+// Parsers still copy the text into their tokenizer, which only takes a
+// string, so a parsed source is held on the heap once. Sizes are 64-bit
+// throughout.
+struct MappedFile {
+	MappedFile();
+	MappedFile(const MappedFile &) = delete;
+	~MappedFile();
+
+	MappedFile &operator=(const MappedFile &) = delete;
+
+	const char *data;
+	size_t size;
+
+	bool open(std::filesystem::path path);
+	void close();
+
+	std::string_view view() const;
+
+private:
+	void *mapping;
+	// used when the file can't be mapped
+	std::string buffer;
+};
@@ -0,0 +1,108 @@
+#include "pool.h"
+
+thread_local ThreadPool *ThreadPool::current = nullptr;
+thread_local int ThreadPool::worker = -1;
+
+ThreadPool::ThreadPool(int workers) {
+	if (workers <= 0) {
+		workers = concurrency();
+	}
+
+	pending = 0;
+	next = 0;
+	done = false;
+
+	queues.resize(workers);
+	threads.reserve(workers);
+	for (int i = 0; i < workers; i++) {
+		threads.push_back(std::thread(&ThreadPool::run, this, i));
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	wait();
+
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		done = true;
+	}
+	ready.notify_all();
+
+	for (auto i = threads.begin(); i != threads.end(); i++) {
+		i->join();
+	}
+}
+
+int ThreadPool::size() const {
+	return (int)queues.size();
+}
+
+void ThreadPool::push(Task task) {
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		int index = worker;
+		if (current != this) {
+			index = next;
+			next = (next+1)%(int)queues.size();
+		}
+		queues[index].push_back(std::move(task));
+		pending++;
+	}
+	ready.notify_one();
+}
+
+void ThreadPool::wait() {
+	std::unique_lock<std::mutex> guard(lock);
+	idle.wait(guard, [this]() { return pending == 0; });
+}
+
+int ThreadPool::concurrency() {
+	int result = (int)std::thread::hardware_concurrency();
+	return result > 0 ? result : 1;
+}
+
+bool ThreadPool::working() {
+	return current != nullptr;
+}
+
+// lock must be held by the caller
+bool ThreadPool::pop(int index, Task &task) {
+	if (not queues[index].empty()) {
+		task = std::move(queues[index].back());
+		queues[index].pop_back();
+		return true;
+	}
+
+	for (int i = 1; i < (int)queues.size(); i++) {
+		deque<Task> &victim = queues[(index+i)%(int)queues.size()];
+		if (not victim.empty()) {
+			task = std::move(victim.front());
+			victim.pop_front();
+			return true;
+		}
+	}
+	return false;
+}
+
+void ThreadPool::run(int index) {
+	current = this;
+	worker = index;
+
+	std::unique_lock<std::mutex> guard(lock);
+	while (true) {
+		Task task;
+		if (pop(index, task)) {
+			guard.unlock();
+			task();
+			task = nullptr;
+			guard.lock();
+			if (--pending == 0) {
+				idle.notify_all();
+			}
+		} else if (done) {
+			break;
+		} else {
+			ready.wait(guard);
+		}
+	}
+}
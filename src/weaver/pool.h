@@ -0,0 +1,55 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+using std::vector;
+using std::deque;
+
+// A fixed size pool of worker threads. Each worker owns a queue of tasks.
+// Tasks pushed from inside a worker go onto that worker's own queue and are
+// executed most-recent-first to keep follow-up work on the same thread. Idle
+// workers steal the oldest task from their neighbors.
+struct ThreadPool {
+	typedef std::function<void()> Task;
+
+	// workers <= 0 uses one worker per hardware thread
+	ThreadPool(int workers=0);
+	~ThreadPool();
+
+	vector<deque<Task> > queues;
+	vector<std::thread> threads;
+
+	std::mutex lock;
+	std::condition_variable ready;
+	std::condition_variable idle;
+
+	// number of tasks that have been pushed but not yet completed
+	int pending;
+	// round robin index for tasks pushed from outside the pool
+	int next;
+	bool done;
+
+	int size() const;
+
+	void push(Task task);
+	// Block until every pushed task, including the tasks they push, has
+	// completed. This must not be called from inside a task.
+	void wait();
+
+	static int concurrency();
+	// whether the calling thread is a worker of any pool, nested stages use
+	// this to run inline instead of starting another pool per task
+	static bool working();
+
+private:
+	static thread_local ThreadPool *current;
+	static thread_local int worker;
+
+	bool pop(int index, Task &task);
+	void run(int index);
+};
@@ -0,0 +1,160 @@
+#include "profile.h"
+
+#include <cstdio>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+#ifdef __APPLE__
+#include <mach/mach.h>
+#endif
+
+namespace {
+
+string escape(const string &str) {
+	string result;
+	result.reserve(str.size());
+	for (auto c = str.begin(); c != str.end(); c++) {
+		if (*c == '"' or *c == '\\') {
+			result.push_back('\\');
+			result.push_back(*c);
+		} else if ((unsigned char)*c < 0x20) {
+			char buffer[8];
+			snprintf(buffer, sizeof(buffer), "\\u%04x", (unsigned)(unsigned char)*c);
+			result += buffer;
+		} else {
+			result.push_back(*c);
+		}
+	}
+	return result;
+}
+
+}
+
+Profile::Profile() {
+}
+
+Profile::~Profile() {
+}
+
+void Profile::record(Sample sample) {
+	std::lock_guard<std::mutex> guard(lock);
+	samples.push_back(sample);
+}
+
+// Process statistics are not collected on Windows, they are reported as 0
+
+double Profile::processCpu() {
+#ifdef _WIN32
+	return 0.0;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0) {
+		return 0.0;
+	}
+	return (double)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) + (double)(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec)*1e-6;
+#endif
+}
+
+int64_t Profile::peakRss() {
+#ifdef _WIN32
+	return 0;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0) {
+		return 0;
+	}
+#ifdef __APPLE__
+	// reported in bytes
+	return (int64_t)usage.ru_maxrss/1024;
+#else
+	return (int64_t)usage.ru_maxrss;
+#endif
+#endif
+}
+
+int64_t Profile::rss() {
+#if defined(__APPLE__)
+	mach_task_basic_info_data_t info;
+	mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+	if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) != KERN_SUCCESS) {
+		return 0;
+	}
+	return (int64_t)info.resident_size/1024;
+#elif defined(__linux__)
+	// the second field is the resident set in pages
+	FILE *fptr = fopen("/proc/self/statm", "r");
+	if (fptr == nullptr) {
+		return 0;
+	}
+	long long size = 0, resident = 0;
+	int read = fscanf(fptr, "%lld %lld", &size, &resident);
+	fclose(fptr);
+	if (read != 2) {
+		return 0;
+	}
+	return (int64_t)resident*(int64_t)sysconf(_SC_PAGESIZE)/1024;
+#else
+	return 0;
+#endif
+}
+
+bool Profile::write(std::filesystem::path path, double wall, int jobs) {
+	std::lock_guard<std::mutex> guard(lock);
+
+	string pathstr = path.string();
+	FILE *fout = fopen(pathstr.c_str(), "w");
+	if (fout == nullptr) {
+		printf("error: unable to write to file '%s'\n", pathstr.c_str());
+		return false;
+	}
+
+	fprintf(fout, "{\n");
+	fprintf(fout, "\t\"version\": 3,\n");
+	fprintf(fout, "\t\"jobs\": %d,\n", jobs);
+	fprintf(fout, "\t\"wall\": %.6f,\n", wall);
+	fprintf(fout, "\t\"process_peak_rss_kb\": %lld,\n", (long long)peakRss());
+	fprintf(fout, "\t\"stages\": [");
+	for (int i = 0; i < (int)samples.size(); i++) {
+		const Sample &s = samples[i];
+		fprintf(fout, "%s\n\t\t{\"module\": \"%s\", \"term\": \"%s\", \"stage\": \"%s\", \"wall\": %.6f, \"process_cpu\": %.6f, \"process_peak_rss_kb\": %lld, \"process_rss_delta_kb\": %lld, \"metrics\": {",
+			i == 0 ? "" : ",", escape(s.module).c_str(), escape(s.term).c_str(), escape(s.stage).c_str(), s.wall, s.cpu, (long long)s.processPeakRss, (long long)s.processRssDelta);
+		for (int j = 0; j < (int)s.metrics.size(); j++) {
+			fprintf(fout, "%s\"%s\": %lld", j == 0 ? "" : ", ", escape(s.metrics[j].first).c_str(), (long long)s.metrics[j].second);
+		}
+		fprintf(fout, "}}");
+	}
+	fprintf(fout, "\n\t]\n}\n");
+	fclose(fout);
+	return true;
+}
+
+Stage::Stage(Profile *profile, string module, string term, string stage) {
+	this->profile = profile;
+	if (profile != nullptr) {
+		sample.module = module;
+		sample.term = term;
+		sample.stage = stage;
+		start = std::chrono::steady_clock::now();
+		cpuStart = Profile::processCpu();
+		rssStart = Profile::rss();
+	}
+}
+
+Stage::~Stage() {
+	if (profile != nullptr) {
+		sample.wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		sample.cpu = Profile::processCpu() - cpuStart;
+		sample.processPeakRss = Profile::peakRss();
+		sample.processRssDelta = Profile::rss() - rssStart;
+		profile->record(sample);
+	}
+}
+
+void Stage::metric(string name, int64_t value) {
+	if (profile != nullptr) {
+		sample.metrics.push_back(std::pair<string, int64_t>(name, value));
+	}
+}
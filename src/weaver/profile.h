@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <filesystem>
+
+using std::string;
+using std::vector;
+
+// Collects the cost of each stage of each term for lm build --profile and
+// writes it out as json.
+struct Profile {
+	struct Sample {
+		string module;
+		string term;
+		string stage;
+		// seconds, cpu is the time used by the whole process during the stage
+		// so it includes any stages that ran alongside it with -j
+		double wall;
+		double cpu;
+		// high-water mark of the whole process when the stage finished, in KiB,
+		// not the memory used by the stage itself
+		int64_t processPeakRss;
+		// change in the resident set of the whole process over the stage in
+		// KiB, negative if memory was returned to the system
+		int64_t processRssDelta;
+		vector<std::pair<string, int64_t> > metrics;
+	};
+
+	Profile();
+	~Profile();
+
+	std::mutex lock;
+	vector<Sample> samples;
+
+	void record(Sample sample);
+	bool write(std::filesystem::path path, double wall, int jobs);
+
+	// CPU time consumed by every thread of the process in seconds
+	static double processCpu();
+	static int64_t peakRss();
+	// the current resident set of the process in KiB
+	static int64_t rss();
+};
+
+// Measures a stage from construction until it goes out of scope and records
+// it into the profile. Does nothing if the profile is null.
+struct Stage {
+	Stage(Profile *profile, string module, string term, string stage);
+	~Stage();
+
+	Profile *profile;
+	Profile::Sample sample;
+	std::chrono::steady_clock::time_point start;
+	double cpuStart;
+	int64_t rssStart;
+
+	void metric(string name, int64_t value);
+};
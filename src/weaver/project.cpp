@@ -1,14 +1,39 @@
 #include "project.h"
+#include "mapped.h"
+#include "pool.h"
+#include "hash.h"
 
+#include <common/message.h>
 #include <common/text.h>
 #include <filesystem>
 
 #include <parse/default/block_comment.h>
 #include <parse/default/line_comment.h>
 #include <parse_ucs/modfile.h>
+#include <phy/Script.h>
 
 namespace weaver {
 
+Resident resident;
+
+// Collects the calls to Project::incl made by the parser running on this
+// thread so that they can be replayed when the parse is reused.
+static thread_local vector<pair<fs::path, fs::path> > *recording = nullptr;
+// The source being parsed on this thread, recorded as the includer by incl().
+static thread_local const fs::path *including = nullptr;
+
+// Identify a file by its modification time and size, returns false if it
+// can't be read.
+static bool fileStamp(fs::path path, fs::file_time_type &mtime, uintmax_t &size) {
+	std::error_code ec;
+	mtime = fs::last_write_time(path, ec);
+	if (ec) {
+		return false;
+	}
+	size = fs::file_size(path, ec);
+	return not ec;
+}
+
 Filetype::Filetype() {
 	read = nullptr;
 	load = nullptr;
@@ -28,6 +53,10 @@ Filetype::~Filetype() {
 }
 
 Project::Project() {
+	jobs = 1;
+	readers = nullptr;
+	readFailed = false;
+
 	workDir = fs::current_path();
 	rootDir = workDir;
 	while (not rootDir.empty()
@@ -80,6 +109,10 @@ const Filetype *Project::getDialect(string dialect) const {
 }
 
 bool Project::incl(fs::path path, fs::path from) {
+	if (recording != nullptr) {
+		recording->push_back(pair<fs::path, fs::path>(path, from));
+	}
+
 	if (from.empty()) {
 		from = workDir;
 	}
@@ -105,15 +138,22 @@ bool Project::incl(fs::path path, fs::path from) {
 		return false;
 	}
 	
+	std::lock_guard<std::mutex> guard(importLock);
+	if (including != nullptr) {
+		includedBy[fs::absolute(filename).lexically_normal()].insert(*including);
+	}
 	auto pos = find(imports.begin(), imports.end(), filename);
 	if (pos == imports.end()) {
 		imports.push_back(filename);
+		if (readers != nullptr) {
+			schedule((int)imports.size()-1);
+		}
 	}
 
 	return true;	
 }
 
-bool Project::read(Program &prgm, fs::path path) {
+bool Project::parse(Source &source, fs::path path) {
 	if (path.empty()) {
 		return false;
 	}
@@ -130,40 +170,164 @@ bool Project::read(Program &prgm, fs::path path) {
 		canon = workDir / canon;
 	}
 
-	sources.push_back(Source());
-	sources.back().path = fs::relative(canon, workDir);
-	sources.back().modName = pathToModule(canon);
-	sources.back().filetype = filetype;
-	sources.back().tokens = shared_ptr<tokenizer>(new tokenizer());
+	source.path = fs::relative(canon, workDir);
+	source.modName = pathToModule(canon);
+	source.filetype = filetype;
+	source.tokens = shared_ptr<tokenizer>(new tokenizer());
 
 	if (filetype->read != nullptr) {
-		ifstream fin;
-		string pathstr = path.string();
-		fin.open(pathstr.c_str(), ios::binary | ios::in);
-		if (not fin.is_open()) {
+		fs::path self = fs::absolute(path).lexically_normal();
+		auto *prevIncluding = including;
+		including = &self;
+		bool reused = resident.enabled and reuse(source, path);
+		including = prevIncluding;
+		if (reused) {
+			return true;
+		}
+
+		fs::file_time_type mtime;
+		uintmax_t size = 0;
+		bool stamped = resident.enabled and fileStamp(path, mtime, size);
+
+		MappedFile file;
+		if (not file.open(path)) {
+			string pathstr = path.string();
 			printf("error: file not found '%s'\n", pathstr.c_str());
 			return false;
 		}
 
-		fin.seekg(0, ios::end);
-		int size = (int)fin.tellg();
-		string buffer(size, ' ');
-		fin.seekg(0, ios::beg);
-		fin.read(&buffer[0], size);
-		fin.close();
+		vector<pair<fs::path, fs::path> > includes;
+		int errors = num_errors;
+		auto *prev = recording;
+		recording = &includes;
+		including = &self;
+		filetype->read(*this, source, file.view());
+		recording = prev;
+		including = prevIncluding;
+
+		// A file with errors is parsed again every time so that its errors
+		// are reported again until it is fixed.
+		if (stamped and source.syntax != nullptr and num_errors == errors) {
+			std::lock_guard<std::mutex> guard(resident.lock);
+			resident.sources[self.string()] = Resident::Parsed{mtime, size, source.syntax, source.tokens, includes};
+		}
+	}
+	return true;
+}
 
-		filetype->read(*this, sources.back(), buffer);
+// Take the syntax of an unchanged file from the resident cache
+bool Project::reuse(Source &source, fs::path path) {
+	fs::file_time_type mtime;
+	uintmax_t size = 0;
+	if (not fileStamp(path, mtime, size)) {
+		return false;
+	}
+
+	vector<pair<fs::path, fs::path> > includes;
+	{
+		std::lock_guard<std::mutex> guard(resident.lock);
+		auto pos = resident.sources.find(fs::absolute(path).lexically_normal().string());
+		if (pos == resident.sources.end() or pos->second.mtime != mtime or pos->second.size != size) {
+			return false;
+		}
+		source.syntax = pos->second.syntax;
+		source.tokens = pos->second.tokens;
+		includes = pos->second.includes;
+	}
+
+	for (auto i = includes.begin(); i != includes.end(); i++) {
+		incl(i->first, i->second);
+	}
+	return true;
+}
+
+bool Project::read(Program &prgm, fs::path path) {
+	sources.push_back(Source());
+	if (not parse(sources.back(), path)) {
+		if (sources.back().filetype == nullptr) {
+			sources.pop_back();
+		}
+		return false;
 	}
 	return true;
 }
 
+// must be called with importLock held
+void Project::schedule(int index) {
+	parsing.push_back(Source());
+	// elements of a deque stay put as it grows
+	Source *source = &parsing.back();
+	fs::path path = imports[index];
+	readers->push([this, source, path]() {
+		if (not parse(*source, path)) {
+			std::lock_guard<std::mutex> guard(importLock);
+			readFailed = true;
+		}
+	});
+}
+
+// Parse every import on a pool of jobs threads. Sources are independent, each
+// has its own tokenizer, so only the discovery of new imports through incl()
+// is synchronized. The parsed sources are appended to sources in the order of
+// imports, same as calling read() on each of them.
+bool Project::readAll() {
+	ThreadPool pool(jobs);
+	{
+		std::lock_guard<std::mutex> guard(importLock);
+		readers = &pool;
+		readFailed = false;
+		parsing.clear();
+		for (int i = 0; i < (int)imports.size(); i++) {
+			schedule(i);
+		}
+	}
+	pool.wait();
+
+	std::lock_guard<std::mutex> guard(importLock);
+	readers = nullptr;
+	for (auto i = parsing.begin(); i != parsing.end(); i++) {
+		if (i->filetype != nullptr) {
+			sources.push_back(std::move(*i));
+		}
+	}
+	parsing.clear();
+	return not readFailed;
+}
+
+std::set<fs::path> Project::dependents(std::set<fs::path> changed) const {
+	std::set<fs::path> result;
+	vector<fs::path> stack;
+	for (auto i = changed.begin(); i != changed.end(); i++) {
+		stack.push_back(fs::absolute(*i).lexically_normal());
+	}
+	while (not stack.empty()) {
+		fs::path curr = stack.back();
+		stack.pop_back();
+		if (not result.insert(curr).second) {
+			continue;
+		}
+
+		auto pos = includedBy.find(curr);
+		if (pos != includedBy.end()) {
+			stack.insert(stack.end(), pos->second.begin(), pos->second.end());
+		}
+	}
+	return result;
+}
+
 bool Project::load(Program &prgm) {
 	// TODO(edward.bingham) this is still wrong, we have to create a DAG and walk the DAG backwards from the leaves...
 	
-	for (int i = 0; i < (int)imports.size(); i++) {
-		if (not read(prgm, imports[i])) {
+	if (jobs > 1) {
+		if (not readAll()) {
 			return false;
 		}
+	} else {
+		for (int i = 0; i < (int)imports.size(); i++) {
+			if (not read(prgm, imports[i])) {
+				return false;
+			}
+		}
 	}
 
 	while (not sources.empty()) {
@@ -176,17 +340,12 @@ bool Project::load(Program &prgm) {
 	return true;
 }
 
-bool Project::save(Program &prgm, int modIdx, int termIdx) const {
-	string dialect = prgm.mods[modIdx].terms[termIdx].dialect().name;
+fs::path Project::emitPath(string dialect, string mod, string name) const {
 	auto filetype = getDialect(dialect);
 	if (filetype == nullptr or filetype->write == nullptr) {
-		return false;
+		return fs::path();
 	}
 
-	fs::path emitDir = (rootDir / BUILD / filetype->build).string();
-	std::filesystem::create_directories(emitDir.string());
-	
-	string mod = prgm.mods[modIdx].name;
 	if (mod.rfind(modName+"/", 0) != string::npos) {
 		mod = mod.substr(modName.size()+1);
 	}
@@ -195,8 +354,28 @@ bool Project::save(Program &prgm, int modIdx, int termIdx) const {
 		mod = mod.substr(0, pos);
 	}
 
-	string filename = mod + "_" + prgm.mods[modIdx].terms[termIdx].decl.name + "." + filetype->ext;
-	filetype->write((emitDir / filename).string(), *this, prgm, modIdx, termIdx);
+	return rootDir / BUILD / filetype->build / (mod + "_" + name + "." + filetype->ext);
+}
+
+void Project::setStreamed(fs::path path) {
+	std::lock_guard<std::mutex> guard(emitLock);
+	streamed.insert(path);
+}
+
+bool Project::save(Program &prgm, int modIdx, int termIdx) const {
+	string dialect = prgm.mods[modIdx].terms[termIdx].dialect().name;
+	fs::path path = emitPath(dialect, prgm.mods[modIdx].name, prgm.mods[modIdx].terms[termIdx].decl.name);
+	if (path.empty()) {
+		return false;
+	}
+
+	// already written while it was being generated
+	if (streamed.find(path) != streamed.end()) {
+		return true;
+	}
+
+	std::filesystem::create_directories(path.parent_path());
+	getDialect(dialect)->write(path.string(), *this, prgm, modIdx, termIdx);
 	return true;
 }
 
@@ -212,6 +391,49 @@ void Project::save(Program &prgm) const {
 	}
 }
 
+void resetMessages() {
+	num_errors = 0;
+	num_warnings = 0;
+}
+
+bool loadTech(phy::Tech &tech) {
+	string key = tech.path + "\n" + tech.lib;
+	Hasher hash;
+	bool hashed = resident.enabled and hash.addFile(extractPath(tech.path));
+	if (hashed) {
+		std::lock_guard<std::mutex> guard(resident.lock);
+		auto pos = resident.techs.find(key);
+		if (pos != resident.techs.end() and pos->second.digest == hash.value) {
+			tech = pos->second.tech;
+			return true;
+		}
+	}
+
+	if (not phy::loadTech(tech)) {
+		return false;
+	}
+
+	if (hashed) {
+		std::lock_guard<std::mutex> guard(resident.lock);
+		resident.techs.erase(key);
+		resident.techs.insert(pair<string, Resident::Evaluated>(key, Resident::Evaluated{hash.value, tech}));
+	}
+	return true;
+}
+
+bool Project::loadTech() {
+	std::lock_guard<std::mutex> guard(techLock);
+	if (tech.isLoaded()) {
+		return true;
+	}
+
+	if (not weaver::loadTech(tech)) {
+		cout << "Unable to load techfile \'" + tech.path + "\'." << endl;
+		return false;
+	}
+	return true;
+}
+
 void Project::setTechPath(string arg, bool setCells) {
 	string path = extractPath(arg);
 	string opt = (arg.size() > path.size() ? arg.substr(path.size()+1) : "");
@@ -291,19 +513,11 @@ void Project::readMod() {
 	tokens.register_token<parse::line_comment>(false);
 	parse_ucs::modfile::register_syntax(tokens);
 
-	ifstream fin;
-	string pathstr = (rootDir / "lm.mod").string();
-	fin.open(pathstr.c_str(), ios::binary | ios::in);
-	if (!fin.is_open()) {
+	MappedFile file;
+	if (not file.open(rootDir / "lm.mod")) {
 		tokens.error("file not found '" + (rootDir / "lm.mod").string() + "'", __FILE__, __LINE__);
 	} else {
-		fin.seekg(0, ios::end);
-		int size = (int)fin.tellg();
-		string buffer(size, ' ');
-		fin.seekg(0, ios::beg);
-		fin.read(&buffer[0], size);
-		fin.clear();
-		tokens.insert((rootDir / "lm.mod").string(), buffer, nullptr);
+		tokens.insert((rootDir / "lm.mod").string(), string(file.view()), nullptr);
 	}
 
 	tokens.increment(true);
@@ -5,9 +5,15 @@
 #include <weaver/program.h>
 
 #include <filesystem>
+#include <deque>
+#include <set>
+#include <mutex>
+#include <string_view>
 
 namespace fs = std::filesystem;
 
+struct ThreadPool;
+
 namespace weaver {
 
 struct Project;
@@ -23,12 +29,14 @@ struct Source {
 	string modName;
 	shared_ptr<parse::syntax> syntax;
 	shared_ptr<tokenizer> tokens;
-	const Filetype *filetype;
+	const Filetype *filetype = nullptr;
 };
 
 struct Filetype {
-	// Project &proj, string path, string buffer
-	typedef void (*Parser)(Project &, Source &, string);
+	// Project &proj, Source &source, string_view buffer
+	// buffer is only valid for the duration of the call, so the tokenizer
+	// keeps its own copy
+	typedef void (*Parser)(Project &, Source &, std::string_view);
 	// Project &proj, Program &prgm, string path, parse::syntax *syntax
 	typedef void (*Loader)(Project &, Program &, const Source &source);
 	// Program &prgm, int modIdx, int termIdx
@@ -47,6 +55,43 @@ struct Filetype {
 	Writer write;
 };
 
+// Parsed sources and evaluated techfiles that outlive a single Project. lm
+// serve enables this so that each request reuses the work of the ones before
+// it. Sources are dropped when the file's modification time or size changes,
+// techfiles when the hash of the script changes.
+struct Resident {
+	struct Parsed {
+		fs::file_time_type mtime;
+		uintmax_t size;
+		shared_ptr<parse::syntax> syntax;
+		shared_ptr<tokenizer> tokens;
+		// calls to Project::incl made while parsing, replayed on reuse
+		vector<pair<fs::path, fs::path> > includes;
+	};
+
+	struct Evaluated {
+		uint64_t digest;
+		phy::Tech tech;
+	};
+
+	bool enabled = false;
+	std::mutex lock;
+	map<string, Parsed> sources;
+	map<string, Evaluated> techs;
+};
+
+extern Resident resident;
+
+// Forget the errors and warnings counted so far. Long running commands call
+// this so that each request or rebuild is judged on its own messages.
+void resetMessages();
+
+// Evaluate the techfile, or copy it from the resident cache if the script
+// hasn't changed since it was last evaluated. The cache only lives as long as
+// lm serve, phy::Tech has no on-disk form, so every invocation that runs
+// without a server still evaluates the script once.
+bool loadTech(phy::Tech &tech);
+
 struct Project {
 	Project();
 	~Project();
@@ -69,8 +114,22 @@ struct Project {
 	vector<fs::path> imports;
 	vector<Source> sources;
 
+	// The sources that include each import, keyed by absolute path. Filled in
+	// by incl() as the sources are parsed.
+	map<fs::path, std::set<fs::path> > includedBy;
+
 	vector<Filetype> filetypes;
 
+	// guards the lazy evaluation of the techfile across threads
+	std::mutex techLock;
+
+	// number of threads used to parse the sources in load()
+	int jobs;
+
+	// outputs that were streamed to disk during the build, guarded by emitLock
+	std::mutex emitLock;
+	std::set<fs::path> streamed;
+
 	int pushFiletype(string dialect, string ext, string build, Filetype::Parser read, Filetype::Loader load, Filetype::Writer write=nullptr);	
 	const Filetype *getExtension(string ext) const;
 	const Filetype *getDialect(string dialect) const;
@@ -78,10 +137,20 @@ struct Project {
 	bool incl(fs::path path, fs::path from="");	
 	bool read(Program &prgm, fs::path path);
 	bool load(Program &prgm);
-
+	bool readAll();
+	// The changed files and every source that includes one of them, directly
+	// or through other sources.
+	std::set<fs::path> dependents(std::set<fs::path> changed) const;
+
+	// Where save() writes the term with the given name from module mod, empty
+	// if the dialect can't be written.
+	fs::path emitPath(string dialect, string mod, string name) const;
+	// Mark an output as written already so that save() leaves it alone.
+	void setStreamed(fs::path path);
 	bool save(Program &prgm, int modIdx, int termIdx) const;
 	void save(Program &prgm) const;
 
+	bool loadTech();
 	void setTechPath(string arg, bool setCells=true);
 	void setCellsDir(string arg);
 	void setTech(string techName);
@@ -97,6 +166,18 @@ struct Project {
 	string pathToModule(fs::path path) const;
 
 	fs::path buildPath(string dialect, string filename) const;
+
+private:
+	// State for readAll(). Includes discovered while parsing are scheduled on
+	// readers, and parsing holds one Source per entry in imports.
+	std::mutex importLock;
+	ThreadPool *readers;
+	std::deque<Source> parsing;
+	bool readFailed;
+
+	bool parse(Source &source, fs::path path);
+	bool reuse(Source &source, fs::path path);
+	void schedule(int index);
 };
 
 }
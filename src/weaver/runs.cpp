@@ -0,0 +1,108 @@
+#include "runs.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+
+namespace fs = std::filesystem;
+
+SortedRuns::SortedRuns() {
+	runs = 0;
+	count = 0;
+}
+
+SortedRuns::~SortedRuns() {
+	close();
+}
+
+bool SortedRuns::open(fs::path dir) {
+	close();
+	std::error_code ec;
+	fs::create_directories(dir, ec);
+	if (ec) {
+		return false;
+	}
+	this->dir = dir;
+	return true;
+}
+
+void SortedRuns::close() {
+	if (not dir.empty()) {
+		std::error_code ec;
+		fs::remove_all(dir, ec);
+		dir.clear();
+	}
+	runs = 0;
+	count = 0;
+}
+
+fs::path SortedRuns::path(int run) const {
+	return dir / ("run" + std::to_string(run));
+}
+
+// Each key is written as its 4 byte length followed by its bytes
+bool SortedRuns::add(std::vector<std::string> keys) {
+	if (dir.empty()) {
+		return false;
+	}
+	std::sort(keys.begin(), keys.end());
+	keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+	FILE *fptr = fopen(path(runs).string().c_str(), "wb");
+	if (fptr == nullptr) {
+		return false;
+	}
+	bool ok = true;
+	for (auto key = keys.begin(); ok and key != keys.end(); key++) {
+		uint32_t length = (uint32_t)key->size();
+		ok = fwrite(&length, sizeof(length), 1, fptr) == 1
+			and fwrite(key->data(), 1, key->size(), fptr) == key->size();
+	}
+	ok = (fclose(fptr) == 0) and ok;
+	if (not ok) {
+		std::error_code ec;
+		fs::remove(path(runs), ec);
+		return false;
+	}
+	runs++;
+	count += keys.size();
+	return true;
+}
+
+std::vector<std::string> SortedRuns::missing(std::vector<std::string> keys) const {
+	std::sort(keys.begin(), keys.end());
+	keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+	std::vector<bool> found(keys.size(), false);
+	std::string key;
+	for (int run = 0; run < runs and not keys.empty(); run++) {
+		FILE *fptr = fopen(path(run).string().c_str(), "rb");
+		if (fptr == nullptr) {
+			continue;
+		}
+
+		size_t i = 0;
+		uint32_t length = 0;
+		while (i < keys.size() and fread(&length, sizeof(length), 1, fptr) == 1) {
+			key.resize(length);
+			if (fread(key.data(), 1, length, fptr) != length) {
+				break;
+			}
+			while (i < keys.size() and keys[i] < key) {
+				i++;
+			}
+			if (i < keys.size() and keys[i] == key) {
+				found[i++] = true;
+			}
+		}
+		fclose(fptr);
+	}
+
+	std::vector<std::string> result;
+	for (size_t i = 0; i < keys.size(); i++) {
+		if (not found[i]) {
+			result.push_back(std::move(keys[i]));
+		}
+	}
+	return result;
+}
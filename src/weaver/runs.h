@@ -0,0 +1,34 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// A set of strings kept on disk as sorted runs, for sets that outgrow
+// memory. Runs are only ever added, and membership is checked for a whole
+// batch of keys at once by merging them against each run in one pass.
+struct SortedRuns {
+	SortedRuns();
+	SortedRuns(const SortedRuns &) = delete;
+	~SortedRuns();
+
+	SortedRuns &operator=(const SortedRuns &) = delete;
+
+	std::filesystem::path dir;
+	int runs;
+	// the number of keys written, a key in several runs counts once per run
+	size_t count;
+
+	// Create the directory the runs are written to
+	bool open(std::filesystem::path dir);
+	// Remove the runs along with their directory
+	void close();
+
+	// Write the keys out as a new run
+	bool add(std::vector<std::string> keys);
+	// The keys that are in none of the runs, sorted and without duplicates
+	std::vector<std::string> missing(std::vector<std::string> keys) const;
+
+private:
+	std::filesystem::path path(int run) const;
+};
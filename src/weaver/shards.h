@@ -0,0 +1,65 @@
+#pragma once
+
+#include <functional>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
+
+// A hash set split into independently locked shards, so threads inserting
+// different keys rarely wait on each other. A key always lands in the same
+// shard, picked from a mix of its hash.
+template <typename Key, typename Hash=std::hash<Key> >
+struct ShardedSet {
+	struct Shard {
+		mutable std::mutex lock;
+		std::unordered_set<Key, Hash> keys;
+	};
+
+	ShardedSet(int count=64) : shards(count) {
+	}
+
+	std::vector<Shard> shards;
+
+	// Returns true if the key was not already in the set
+	bool insert(const Key &key) {
+		Shard &shard = at(key);
+		std::lock_guard<std::mutex> guard(shard.lock);
+		return shard.keys.insert(key).second;
+	}
+
+	bool contains(const Key &key) const {
+		const Shard &shard = shards[index(key)];
+		std::lock_guard<std::mutex> guard(shard.lock);
+		return shard.keys.find(key) != shard.keys.end();
+	}
+
+	size_t size() const {
+		size_t result = 0;
+		for (auto i = shards.begin(); i != shards.end(); i++) {
+			std::lock_guard<std::mutex> guard(i->lock);
+			result += i->keys.size();
+		}
+		return result;
+	}
+
+	// Move every key out, leaving the set empty. Must not run alongside
+	// other calls.
+	std::vector<Key> take() {
+		std::vector<Key> result;
+		for (auto i = shards.begin(); i != shards.end(); i++) {
+			while (not i->keys.empty()) {
+				result.push_back(std::move(i->keys.extract(i->keys.begin()).value()));
+			}
+		}
+		return result;
+	}
+
+	size_t index(const Key &key) const {
+		uint64_t h = (uint64_t)Hash()(key) * 0x9E3779B97F4A7C15ull;
+		return (size_t)(h >> 32) % shards.size();
+	}
+
+	Shard &at(const Key &key) {
+		return shards[index(key)];
+	}
+};
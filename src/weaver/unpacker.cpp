@@ -28,11 +28,13 @@
 #include <filesystem>
 
 #include "../format/cell.h"
+#include "pool.h"
 
 Unpack::Unpack(weaver::Project &proj) : proj(proj) {
 	stage = -1;
 	progress = false;
 	debug = false;
+	jobs = 1;
 
 	targets.resize(SIZED+1, false);
 }
@@ -125,7 +127,20 @@ bool Unpack::gdsToSpi(weaver::Program &prgm, int modIdx, int termIdx) const {
 	int dstIdx = prgm.mods[spiceIdx].createTerm(weaver::Term::procOf(spiceKind, name, args));
 
 	sch::Netlist net;
-	extract(net, lib);
+	if (jobs > 1 and lib.macros.size() > 1u) {
+		// Each macro is extracted into its own subckt, the same as extracting
+		// the library as a whole.
+		net.subckts.resize(lib.macros.size());
+		ThreadPool pool(jobs);
+		for (int i = 0; i < (int)lib.macros.size(); i++) {
+			pool.push([&net, &lib, i]() {
+				extract(net.subckts[i], lib.macros[i]);
+			});
+		}
+		pool.wait();
+	} else {
+		extract(net, lib);
+	}
 	prgm.mods[spiceIdx].terms[dstIdx].def = net;
 	return true;
 }
@@ -155,8 +170,7 @@ bool Unpack::spiToPrs(weaver::Program &prgm, int modIdx, int termIdx) const {
 	// TODO(edward.bingham) merge weaver type system and circ types?
 	vector<weaver::Instance> args = decl.args;
 
-	if (not proj.tech.isLoaded() and not phy::loadTech(proj.tech)) {
-		cout << "Unable to load techfile \'" + proj.tech.path + "\'." << endl;
+	if (not proj.loadTech()) {
 		return false;
 	}
 
@@ -167,6 +181,25 @@ bool Unpack::spiToPrs(weaver::Program &prgm, int modIdx, int termIdx) const {
 		// TODO(edward.bingham) pass the variable declarations over to circ
 	}
 
+	if (jobs > 1 and net.subckts.size() > 1u) {
+		// Extract on the pool, then create the terms in subckt order so that
+		// the module looks the same as a sequential unpack.
+		vector<prs::production_rule_set> rules(net.subckts.size());
+		ThreadPool pool(jobs);
+		for (int i = 0; i < (int)net.subckts.size(); i++) {
+			pool.push([this, &rules, &net, i]() {
+				rules[i] = prs::extract_rules(proj.tech, net.subckts[i]);
+			});
+		}
+		pool.wait();
+
+		for (int i = 0; i < (int)net.subckts.size(); i++) {
+			int dstIdx = prgm.mods[circIdx].createTerm(weaver::Term::procOf(circKind, net.subckts[i].name, args));
+			prgm.mods[circIdx].terms[dstIdx].def = std::move(rules[i]);
+		}
+		return true;
+	}
+
 	for (auto ckt = net.subckts.begin(); ckt != net.subckts.end(); ckt++) {
 		int dstIdx = prgm.mods[circIdx].createTerm(weaver::Term::procOf(circKind, ckt->name, args));
 		prgm.mods[circIdx].terms[dstIdx].def = prs::extract_rules(proj.tech, *ckt);
@@ -24,6 +24,9 @@ struct Unpack {
 
 	bool progress;
 	bool debug;
+
+	// number of threads used to extract the macros and subckts of a term
+	int jobs;
 	
 	vector<bool> targets;
 
@@ -0,0 +1,148 @@
+#include "watch.h"
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+Watcher::Watcher() {
+	fd = -1;
+}
+
+Watcher::~Watcher() {
+	close();
+}
+
+#ifdef __linux__
+
+static const uint32_t watchMask = IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF;
+
+bool Watcher::open(std::vector<fs::path> roots) {
+	close();
+	fd = inotify_init1(IN_CLOEXEC);
+	if (fd < 0) {
+		return false;
+	}
+
+	for (auto root = roots.begin(); root != roots.end(); root++) {
+		std::error_code ec;
+		if (not fs::is_directory(*root, ec)) {
+			continue;
+		}
+		add(*root);
+		for (auto entry = fs::recursive_directory_iterator(*root, ec); not ec and entry != fs::recursive_directory_iterator(); entry.increment(ec)) {
+			if (entry->is_directory(ec)) {
+				add(entry->path());
+			}
+		}
+	}
+	return not dirs.empty();
+}
+
+void Watcher::close() {
+	if (fd >= 0) {
+		::close(fd);
+		fd = -1;
+	}
+	dirs.clear();
+}
+
+void Watcher::add(fs::path dir) {
+	int wd = inotify_add_watch(fd, dir.string().c_str(), watchMask);
+	if (wd >= 0) {
+		dirs[wd] = dir;
+	}
+}
+
+// Read the pending events without blocking, returns false if there were none
+bool Watcher::drain(std::set<fs::path> &changed) {
+	alignas(struct inotify_event) char buffer[16384];
+	bool found = false;
+	while (true) {
+		struct pollfd pfd = {fd, POLLIN, 0};
+		if (::poll(&pfd, 1, 0) <= 0) {
+			return found;
+		}
+
+		ssize_t len = read(fd, buffer, sizeof(buffer));
+		if (len <= 0) {
+			return found;
+		}
+
+		for (char *ptr = buffer; ptr < buffer + len; ) {
+			struct inotify_event *event = (struct inotify_event *)ptr;
+			ptr += sizeof(struct inotify_event) + event->len;
+
+			auto dir = dirs.find(event->wd);
+			if (dir == dirs.end()) {
+				continue;
+			}
+			if (event->mask & (IN_IGNORED | IN_DELETE_SELF)) {
+				dirs.erase(dir);
+				continue;
+			}
+			if (event->len == 0) {
+				continue;
+			}
+
+			fs::path path = dir->second / event->name;
+			if ((event->mask & IN_ISDIR) and (event->mask & (IN_CREATE | IN_MOVED_TO))) {
+				add(path);
+			}
+			changed.insert(path);
+			found = true;
+		}
+	}
+}
+
+bool Watcher::wait(std::set<fs::path> &changed, int settleMs) {
+	if (fd < 0) {
+		return false;
+	}
+
+	struct pollfd pfd = {fd, POLLIN, 0};
+	while (not drain(changed)) {
+		if (::poll(&pfd, 1, -1) < 0) {
+			return false;
+		}
+	}
+
+	// editors write a file in several steps, wait until they are done
+	while (::poll(&pfd, 1, settleMs) > 0) {
+		drain(changed);
+	}
+	return true;
+}
+
+bool Watcher::poll(std::set<fs::path> &changed) {
+	return fd >= 0 and drain(changed);
+}
+
+#else
+
+bool Watcher::open(std::vector<fs::path> roots) {
+	return false;
+}
+
+void Watcher::close() {
+}
+
+void Watcher::add(fs::path dir) {
+}
+
+bool Watcher::drain(std::set<fs::path> &changed) {
+	return false;
+}
+
+bool Watcher::wait(std::set<fs::path> &changed, int settleMs) {
+	return false;
+}
+
+bool Watcher::poll(std::set<fs::path> &changed) {
+	return false;
+}
+
+#endif
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <filesystem>
+#include <map>
+#include <set>
+#include <vector>
+
+// Reports the files that change under a set of directories. Directories are
+// watched recursively, including the ones created after open().
+struct Watcher {
+	Watcher();
+	Watcher(const Watcher &) = delete;
+	~Watcher();
+
+	Watcher &operator=(const Watcher &) = delete;
+
+	bool open(std::vector<std::filesystem::path> roots);
+	void close();
+
+	// Block until something changes, then wait for the burst of events from a
+	// single save to settle and return every path that was touched.
+	bool wait(std::set<std::filesystem::path> &changed, int settleMs=100);
+	// Collect the paths touched since the last call without blocking,
+	// returns false if there were none.
+	bool poll(std::set<std::filesystem::path> &changed);
+
+private:
+	int fd;
+	std::map<int, std::filesystem::path> dirs;
+
+	void add(std::filesystem::path dir);
+	bool drain(std::set<std::filesystem::path> &changed);
+};
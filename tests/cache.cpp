@@ -0,0 +1,115 @@
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include <common/standard.h>
+#include <prs/production_rule.h>
+#include <interpret_prs/export.h>
+
+#include "src/weaver/builder.h"
+#include "src/weaver/profile.h"
+#include "src/format/filetypes.h"
+
+namespace {
+
+fs::path scratch(string name) {
+	fs::path dir = fs::temp_directory_path() / ("lm_cache_" + name + "_" + std::to_string((int)getpid()));
+	fs::remove_all(dir);
+	fs::create_directories(dir);
+	return dir;
+}
+
+void writeFile(fs::path path, string content) {
+	std::ofstream fout(path);
+	fout << content;
+}
+
+// Lower the production rules in path through sizing, the last stage before
+// the techfile is needed, and return the result. hit is set if it came from
+// the cache.
+string lowerPrs(fs::path root, fs::path path, bool &hit) {
+	registerDialects();
+	weaver::Project proj;
+	proj.rootDir = root;
+	registerFiletypes(proj);
+
+	Profile profile;
+	Build builder(proj);
+	builder.stage = Build::SIZE;
+	builder.profile = &profile;
+
+	weaver::Program prgm;
+	proj.incl(path);
+	proj.load(prgm);
+	builder.build(prgm);
+
+	hit = false;
+	for (auto i = profile.samples.begin(); i != profile.samples.end(); i++) {
+		for (auto j = i->metrics.begin(); j != i->metrics.end(); j++) {
+			hit = hit or (i->stage == "CACHE" and j->first == "hit" and j->second == 1);
+		}
+	}
+
+	for (auto i = prgm.mods.begin(); i != prgm.mods.end(); i++) {
+		for (auto j = i->terms.begin(); j != i->terms.end(); j++) {
+			if (j->kind >= 0 and j->dialect().name == "circ") {
+				return prs::export_production_rule_set(j->as<prs::production_rule_set>()).to_string();
+			}
+		}
+	}
+	return "";
+}
+
+}
+
+TEST(Cache, RoundTrip) {
+	fs::path root = scratch("roundtrip");
+	writeFile(root / "lm.mod", "");
+	writeFile(root / "inv.prs", "a->b-\n~a->b+\n");
+
+	bool hit = true;
+	string built = lowerPrs(root, root / "inv.prs", hit);
+	EXPECT_FALSE(hit);
+	ASSERT_FALSE(built.empty());
+	EXPECT_TRUE(fs::is_directory(root / weaver::Project::BUILD / "cache"));
+
+	string loaded = lowerPrs(root, root / "inv.prs", hit);
+	EXPECT_TRUE(hit);
+	EXPECT_EQ(built, loaded);
+
+	fs::remove_all(root);
+}
+
+TEST(Cache, KeyCoversUsedCells) {
+	fs::path root = scratch("cells");
+	writeFile(root / "used.gds", "used");
+	writeFile(root / "other.gds", "other");
+
+	weaver::Project proj;
+	proj.rootDir = root;
+	proj.tech.lib = root.string();
+	Build builder(proj);
+
+	vector<string> cells = {"used"};
+	string key = builder.cacheKey("spiToGds", "netlist", false, cells);
+	EXPECT_EQ(key, builder.cacheKey("spiToGds", "netlist", false, cells));
+
+	// cells the netlist doesn't use don't matter
+	writeFile(root / "other.gds", "changed");
+	writeFile(root / "new.gds", "new");
+	EXPECT_EQ(key, builder.cacheKey("spiToGds", "netlist", false, cells));
+
+	writeFile(root / "used.gds", "changed");
+	string edited = builder.cacheKey("spiToGds", "netlist", false, cells);
+	EXPECT_NE(key, edited);
+
+	fs::remove(root / "used.gds");
+	EXPECT_NE(edited, builder.cacheKey("spiToGds", "netlist", false, cells));
+
+	fs::remove_all(root);
+}
@@ -0,0 +1,70 @@
+#include <gtest/gtest.h>
+
+#include "src/weaver/events.h"
+
+TEST(Delay, ParsesDistributions) {
+	Delay d;
+	EXPECT_TRUE(d.parse("100"));
+	EXPECT_EQ(d.kind, Delay::FIXED);
+	EXPECT_TRUE(d.parse("uniform:80,120"));
+	EXPECT_EQ(d.kind, Delay::UNIFORM);
+	EXPECT_TRUE(d.parse("normal:100,10"));
+	EXPECT_EQ(d.kind, Delay::NORMAL);
+	EXPECT_TRUE(d.parse("exp:50"));
+	EXPECT_EQ(d.kind, Delay::EXPONENTIAL);
+
+	EXPECT_FALSE(d.parse("uniform:120,80"));
+	EXPECT_FALSE(d.parse("fixed:10,20"));
+	EXPECT_FALSE(d.parse("gamma:1,2"));
+	EXPECT_FALSE(d.parse("abc"));
+}
+
+TEST(Delay, SamplesWithinBounds) {
+	std::mt19937_64 rng(0);
+	Delay d;
+	ASSERT_TRUE(d.parse("uniform:80,120"));
+	for (int i = 0; i < 1000; i++) {
+		uint64_t t = d.sample(rng);
+		EXPECT_GE(t, 80u);
+		EXPECT_LE(t, 120u);
+	}
+	EXPECT_EQ(Delay(42).sample(rng), 42u);
+}
+
+TEST(EventQueue, PopsInTimeOrder) {
+	EventQueue<int> events;
+	events.schedule(1, 30);
+	events.schedule(2, 10);
+	events.schedule(3, 20);
+	events.schedule(4, 10);
+
+	int key = 0;
+	uint64_t at = 0;
+	ASSERT_TRUE(events.pop(key, at));
+	EXPECT_EQ(key, 2);
+	EXPECT_EQ(at, 10u);
+	// ties are broken by the order of scheduling
+	ASSERT_TRUE(events.pop(key, at));
+	EXPECT_EQ(key, 4);
+	ASSERT_TRUE(events.pop(key, at));
+	EXPECT_EQ(key, 3);
+	ASSERT_TRUE(events.pop(key, at));
+	EXPECT_EQ(key, 1);
+	EXPECT_FALSE(events.pop(key, at));
+}
+
+TEST(EventQueue, SkipsCancelledAndRescheduled) {
+	EventQueue<int> events;
+	events.schedule(1, 10);
+	events.schedule(2, 20);
+	events.schedule(1, 30);
+	events.cancel(2);
+
+	int key = 0;
+	uint64_t at = 0;
+	ASSERT_TRUE(events.pop(key, at));
+	EXPECT_EQ(key, 1);
+	EXPECT_EQ(at, 30u);
+	EXPECT_FALSE(events.pop(key, at));
+	EXPECT_TRUE(events.empty());
+}
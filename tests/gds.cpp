@@ -0,0 +1,117 @@
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "src/format/gdsindex.h"
+
+namespace {
+
+void record(string &out, int type, int datatype, string payload="") {
+	if (payload.size()%2 != 0) {
+		payload.push_back('\0');
+	}
+	size_t length = payload.size()+4;
+	out.push_back((char)((length >> 8) & 0xFF));
+	out.push_back((char)(length & 0xFF));
+	out.push_back((char)type);
+	out.push_back((char)datatype);
+	out += payload;
+}
+
+// A structure that places each of refs once
+void structure(string &out, string name, vector<string> refs) {
+	record(out, 0x05, 0x02, string(24, '\0'));
+	record(out, 0x06, 0x06, name);
+	for (auto ref = refs.begin(); ref != refs.end(); ref++) {
+		record(out, 0x0A, 0x00);
+		record(out, 0x12, 0x06, *ref);
+		record(out, 0x10, 0x03, string(8, '\0'));
+		record(out, 0x11, 0x00);
+	}
+	record(out, 0x07, 0x00);
+}
+
+// via <- inv <- top, and a standalone cell
+string library() {
+	string out;
+	record(out, 0x00, 0x02, string(2, '\0'));
+	record(out, 0x01, 0x02, string(24, '\0'));
+	record(out, 0x02, 0x06, "lib");
+	record(out, 0x03, 0x05, string(16, '\0'));
+	structure(out, "via", {});
+	structure(out, "inv", {"via"});
+	structure(out, "top", {"inv", "inv", "missing"});
+	structure(out, "tap", {});
+	record(out, 0x04, 0x00);
+	return out;
+}
+
+vector<string> names(const GdsIndex &index, vector<int> order) {
+	vector<string> result;
+	for (auto i = order.begin(); i != order.end(); i++) {
+		result.push_back(index.structs[*i].name);
+	}
+	std::sort(result.begin(), result.end());
+	return result;
+}
+
+}
+
+TEST(GdsIndex, Scan) {
+	string data = library();
+	GdsIndex index;
+	ASSERT_TRUE(index.scan(data));
+	ASSERT_EQ(index.structs.size(), 4u);
+	EXPECT_EQ(index.structs[0].name, "via");
+	EXPECT_EQ(index.structs[2].name, "top");
+	EXPECT_EQ(index.structs[2].refs, vector<string>({"inv", "inv", "missing"}));
+	EXPECT_EQ(index.byName.at("tap"), 3);
+	EXPECT_EQ(index.header, index.structs[0].begin);
+	EXPECT_EQ(index.structs[3].end + 4, data.size());
+}
+
+TEST(GdsIndex, Truncated) {
+	string data = library();
+	GdsIndex index;
+	ASSERT_TRUE(index.scan(data));
+	size_t cut = index.structs[1].begin + 10;
+	// cut off in the middle of a structure
+	EXPECT_FALSE(index.scan(data.substr(0, cut)));
+}
+
+TEST(GdsIndex, Closure) {
+	string data = library();
+	GdsIndex index;
+	ASSERT_TRUE(index.scan(data));
+	EXPECT_EQ(index.closure(2)[0], 2);
+	EXPECT_EQ(names(index, index.closure(2)), vector<string>({"inv", "top", "via"}));
+	EXPECT_EQ(names(index, index.closure(1)), vector<string>({"inv", "via"}));
+	EXPECT_EQ(names(index, index.closure(3)), vector<string>({"tap"}));
+}
+
+TEST(GdsIndex, WriteClosure) {
+	string data = library();
+	GdsIndex index;
+	ASSERT_TRUE(index.scan(data));
+
+	std::filesystem::path path = std::filesystem::temp_directory_path() / "lm_gdsindex_test.gds";
+	ASSERT_TRUE(index.write(data, index.closure(1), path));
+
+	std::ifstream fin(path.string(), std::ios::binary);
+	std::stringstream buffer;
+	buffer << fin.rdbuf();
+	string written = buffer.str();
+	std::filesystem::remove(path);
+
+	GdsIndex split;
+	ASSERT_TRUE(split.scan(written));
+	ASSERT_EQ(split.structs.size(), 2u);
+	EXPECT_EQ(split.structs[0].name, "inv");
+	EXPECT_EQ(split.structs[1].name, "via");
+	EXPECT_EQ(written.substr(0, split.header), data.substr(0, index.header));
+}
@@ -0,0 +1,63 @@
+#include <random>
+
+#include <gtest/gtest.h>
+
+#include "src/weaver/lanes.h"
+
+namespace {
+
+// out = ~(a & b) built from a pull up and a pull down network
+void addNand(LaneSim &sim, int a, int b, int out) {
+	sim.addRule(LaneRule{out, 1, {{(a<<1)|1}, {(b<<1)|1}}});
+	sim.addRule(LaneRule{out, 0, {{a<<1, b<<1}}});
+}
+
+}
+
+TEST(LaneSim, EvaluatesEveryLane) {
+	LaneSim sim(3, 200);
+	addNand(sim, 0, 1, 2);
+
+	std::mt19937_64 rng(1);
+	sim.randomize(rng);
+	sim.settle(10);
+	for (int lane = 0; lane < 200; lane++) {
+		int a = sim.get(0, lane);
+		int b = sim.get(1, lane);
+		ASSERT_GE(a, 0);
+		ASSERT_GE(b, 0);
+		EXPECT_EQ(sim.get(2, lane), (a and b) ? 0 : 1);
+	}
+	EXPECT_EQ(sim.count(sim.conflict), 0);
+	EXPECT_EQ(sim.count(sim.unstable), 0);
+}
+
+TEST(LaneSim, UnknownUntilDriven) {
+	LaneSim sim(2, 64);
+	// out = ~a, with a left unknown
+	sim.addRule(LaneRule{1, 1, {{(0<<1)|1}}});
+	sim.addRule(LaneRule{1, 0, {{0<<1}}});
+	sim.set(0, 3, 1);
+	sim.settle(10);
+	EXPECT_EQ(sim.get(1, 3), 0);
+	EXPECT_EQ(sim.get(1, 4), -1);
+}
+
+TEST(LaneSim, FlagsConflictsAndOscillation) {
+	LaneSim sim(3, 64);
+	// net 1 is pulled both ways whenever a is 1
+	sim.addRule(LaneRule{1, 1, {{0<<1}}});
+	sim.addRule(LaneRule{1, 0, {{0<<1}}});
+	// net 2 is a ring oscillator once it is known
+	sim.addRule(LaneRule{2, 1, {{(2<<1)|1}}});
+	sim.addRule(LaneRule{2, 0, {{2<<1}}});
+
+	sim.set(0, 5, 1);
+	sim.set(0, 6, 0);
+	sim.set(2, 9, 0);
+	sim.settle(16);
+	EXPECT_EQ(sim.get(1, 5), -1);
+	EXPECT_EQ(sim.count(sim.conflict), 1);
+	EXPECT_EQ(sim.count(sim.unstable), 1);
+	EXPECT_EQ(sim.get(2, 10), -1);
+}
@@ -0,0 +1,68 @@
+#include <atomic>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "src/weaver/pool.h"
+
+TEST(ThreadPool, RunsEveryTask) {
+	std::atomic<int> count(0);
+	ThreadPool pool(4);
+	for (int i = 0; i < 1000; i++) {
+		pool.push([&count]() {
+			count++;
+		});
+	}
+	pool.wait();
+	EXPECT_EQ(count.load(), 1000);
+}
+
+TEST(ThreadPool, WaitsForNestedTasks) {
+	std::atomic<int> count(0);
+	ThreadPool pool(4);
+	// each task spawns its follow-up, like lowering a term through every stage
+	for (int i = 0; i < 16; i++) {
+		pool.push([&pool, &count]() {
+			for (int depth = 0; depth < 4; depth++) {
+				pool.push([&count]() {
+					count++;
+				});
+			}
+			count++;
+		});
+	}
+	pool.wait();
+	EXPECT_EQ(count.load(), 16*5);
+}
+
+TEST(ThreadPool, ReusableAfterWait) {
+	std::vector<int> result(64, 0);
+	ThreadPool pool(3);
+	for (int round = 1; round <= 3; round++) {
+		for (int i = 0; i < (int)result.size(); i++) {
+			pool.push([&result, i]() {
+				result[i]++;
+			});
+		}
+		pool.wait();
+		for (int i = 0; i < (int)result.size(); i++) {
+			EXPECT_EQ(result[i], round);
+		}
+	}
+}
+
+TEST(ThreadPool, Working) {
+	EXPECT_FALSE(ThreadPool::working());
+	std::atomic<int> inside(0);
+	ThreadPool pool(2);
+	for (int i = 0; i < 8; i++) {
+		pool.push([&inside]() {
+			if (ThreadPool::working()) {
+				inside++;
+			}
+		});
+	}
+	pool.wait();
+	EXPECT_EQ(inside.load(), 8);
+	EXPECT_FALSE(ThreadPool::working());
+}
@@ -0,0 +1,102 @@
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <common/standard.h>
+#include <common/net.h>
+#include <parse/tokenizer.h>
+#include <parse/default/block_comment.h>
+#include <parse/default/line_comment.h>
+
+#include <parse_prs/factory.h>
+#include <prs/production_rule.h>
+#include <interpret_prs/import.h>
+
+#include "src/format/prs.h"
+
+namespace {
+
+prs::production_rule_set importPrsFromString(const string &text) {
+	tokenizer tokens;
+	tokens.register_token<parse::block_comment>(false);
+	tokens.register_token<parse::line_comment>(false);
+	parse_prs::register_syntax(tokens);
+	tokens.insert("string_input", text, nullptr);
+
+	prs::production_rule_set pr;
+	tokens.increment(false);
+	parse_prs::expect(tokens);
+	if (tokens.decrement(__FILE__, __LINE__)) {
+		parse_prs::production_rule_set syntax(tokens);
+		prs::import_production_rule_set(syntax, pr, -1, -1, prs::attributes(), 0, &tokens, true);
+	}
+	return pr;
+}
+
+int netIndex(const prs::production_rule_set &pr, string name) {
+	ucs::ConstNetlist nets(pr);
+	for (int i = 0; i < nets.netCount(); i++) {
+		if (nets.netAt(i) == name) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+// the terms of the rule driving out to value, each sorted, in sorted order
+vector<vector<int> > termsOf(const vector<LaneRule> &rules, int out, int value) {
+	vector<vector<int> > result;
+	for (auto r = rules.begin(); r != rules.end(); r++) {
+		if (r->out == out and r->value == value) {
+			result = r->terms;
+		}
+	}
+	for (auto t = result.begin(); t != result.end(); t++) {
+		std::sort(t->begin(), t->end());
+	}
+	std::sort(result.begin(), result.end());
+	return result;
+}
+
+}
+
+TEST(LaneRules, Nand) {
+	prs::production_rule_set pr = importPrsFromString("a&b->c-\n~a|~b->c+\n");
+	int a = netIndex(pr, "a");
+	int b = netIndex(pr, "b");
+	int c = netIndex(pr, "c");
+	ASSERT_GE(a, 0);
+	ASSERT_GE(b, 0);
+	ASSERT_GE(c, 0);
+
+	vector<LaneRule> rules = laneRules(pr);
+	vector<vector<int> > down = {{std::min(a<<1, b<<1), std::max(a<<1, b<<1)}};
+	vector<vector<int> > up = {{(a<<1)|1}, {(b<<1)|1}};
+	std::sort(up.begin(), up.end());
+	EXPECT_EQ(termsOf(rules, c, 0), down);
+	EXPECT_EQ(termsOf(rules, c, 1), up);
+
+	// only c is driven, and the paths end at the supplies rather than at the
+	// internal node of the pull down stack
+	for (auto r = rules.begin(); r != rules.end(); r++) {
+		EXPECT_EQ(r->out, c);
+	}
+}
+
+TEST(LaneRules, Inverters) {
+	prs::production_rule_set pr = importPrsFromString("a->b-\n~a->b+\nb->c-\n~b->c+\n");
+	int a = netIndex(pr, "a");
+	int b = netIndex(pr, "b");
+	int c = netIndex(pr, "c");
+	ASSERT_GE(a, 0);
+	ASSERT_GE(b, 0);
+	ASSERT_GE(c, 0);
+
+	vector<LaneRule> rules = laneRules(pr);
+	EXPECT_EQ(termsOf(rules, b, 0), vector<vector<int> >({{a<<1}}));
+	EXPECT_EQ(termsOf(rules, b, 1), vector<vector<int> >({{(a<<1)|1}}));
+	EXPECT_EQ(termsOf(rules, c, 0), vector<vector<int> >({{b<<1}}));
+	EXPECT_EQ(termsOf(rules, c, 1), vector<vector<int> >({{(b<<1)|1}}));
+}
@@ -0,0 +1,36 @@
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "src/weaver/runs.h"
+
+using std::string;
+using std::vector;
+
+TEST(SortedRuns, FindsKeysInEveryRun) {
+	SortedRuns runs;
+	std::filesystem::path dir = std::filesystem::path(testing::TempDir()) / "runs";
+	ASSERT_TRUE(runs.open(dir));
+	ASSERT_TRUE(runs.add({"m", "c", "a"}));
+	ASSERT_TRUE(runs.add({"z", "d"}));
+	EXPECT_EQ(runs.runs, 2);
+	EXPECT_EQ(runs.count, 5u);
+
+	// sorted, without duplicates, and without the keys already written
+	vector<string> missing = runs.missing({"b", "z", "a", "e", "b", "", "m"});
+	EXPECT_EQ(missing, vector<string>({"", "b", "e"}));
+
+	runs.close();
+	EXPECT_FALSE(std::filesystem::exists(dir));
+}
+
+TEST(SortedRuns, KeepsBinaryKeys) {
+	SortedRuns runs;
+	ASSERT_TRUE(runs.open(std::filesystem::path(testing::TempDir()) / "binary"));
+	string key("a\0b", 3);
+	ASSERT_TRUE(runs.add({key}));
+	EXPECT_TRUE(runs.missing({key}).empty());
+	EXPECT_EQ(runs.missing({string("a")}).size(), 1u);
+}
@@ -0,0 +1,52 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "src/weaver/shards.h"
+
+TEST(ShardedSet, InsertsOnce) {
+	ShardedSet<uint64_t> set(4);
+	EXPECT_TRUE(set.insert(7));
+	EXPECT_FALSE(set.insert(7));
+	EXPECT_TRUE(set.contains(7));
+	EXPECT_FALSE(set.contains(8));
+	EXPECT_EQ(set.size(), 1u);
+}
+
+TEST(ShardedSet, ConcurrentInsertsClaimEachKeyOnce) {
+	ShardedSet<uint64_t> set;
+	std::atomic<int> claimed(0);
+	std::vector<std::thread> threads;
+	// every thread tries to claim the same keys, as workers reaching the
+	// same state from different parents do
+	for (int t = 0; t < 8; t++) {
+		threads.push_back(std::thread([&set, &claimed]() {
+			for (uint64_t key = 0; key < 10000; key++) {
+				if (set.insert(key)) {
+					claimed++;
+				}
+			}
+		}));
+	}
+	for (auto i = threads.begin(); i != threads.end(); i++) {
+		i->join();
+	}
+	EXPECT_EQ(claimed.load(), 10000);
+	EXPECT_EQ(set.size(), 10000u);
+}
+
+TEST(ShardedSet, TakeEmptiesTheSet) {
+	ShardedSet<std::string> set(4);
+	set.insert("a");
+	set.insert("b");
+	std::vector<std::string> keys = set.take();
+	std::sort(keys.begin(), keys.end());
+	EXPECT_EQ(keys, std::vector<std::string>({"a", "b"}));
+	EXPECT_EQ(set.size(), 0u);
+	EXPECT_TRUE(set.insert("a"));
+}
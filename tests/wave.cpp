@@ -0,0 +1,104 @@
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "src/format/wave.h"
+
+namespace {
+
+struct Change {
+	uint64_t t;
+	int net;
+	char value;
+};
+
+std::vector<Change> readAll(string path, uint64_t from, uint64_t to, vector<string> &names) {
+	std::vector<Change> result;
+	EXPECT_TRUE(read_wave(path, from, to, names, [&result](uint64_t t, int net, char value) {
+		result.push_back(Change{t, net, value});
+	}));
+	return result;
+}
+
+}
+
+TEST(Wave, RoundTripsChanges) {
+	string path = testing::TempDir() + "roundtrip.lmw";
+	WaveWriter wave;
+	ASSERT_TRUE(wave.create(path, {"a", "b"}));
+	wave.stamp(10);
+	wave.change('1', 0);
+	wave.stamp(20);
+	wave.change('0', 1);
+	wave.change('z', 0);
+	wave.close();
+
+	vector<string> names;
+	std::vector<Change> changes = readAll(path, 0, 100, names);
+	ASSERT_EQ(names, vector<string>({"a", "b"}));
+	// the state at the start, then every change
+	ASSERT_EQ(changes.size(), 5u);
+	EXPECT_EQ(changes[0].value, 'x');
+	EXPECT_EQ(changes[1].value, 'x');
+	EXPECT_EQ(changes[2].t, 10u);
+	EXPECT_EQ(changes[2].value, '1');
+	EXPECT_EQ(changes[3].t, 20u);
+	EXPECT_EQ(changes[3].net, 1);
+	EXPECT_EQ(changes[4].value, 'z');
+	remove(path.c_str());
+}
+
+TEST(Wave, SeeksIntoLaterBlocks) {
+	string path = testing::TempDir() + "seek.lmw";
+	WaveWriter wave;
+	wave.blockSize = 16;
+	ASSERT_TRUE(wave.create(path, {"clk"}));
+	for (uint64_t t = 1; t <= 1000; t++) {
+		wave.stamp(t*10);
+		wave.change(t%2 == 1 ? '1' : '0', 0);
+	}
+	wave.close();
+
+	vector<string> names;
+	std::vector<Change> changes = readAll(path, 5005, 5030, names);
+	// clk was set to 0 at 5000, then toggles at 5010, 5020 and 5030
+	ASSERT_EQ(changes.size(), 4u);
+	EXPECT_EQ(changes[0].t, 5005u);
+	EXPECT_EQ(changes[0].value, '0');
+	EXPECT_EQ(changes[1].t, 5010u);
+	EXPECT_EQ(changes[1].value, '1');
+	EXPECT_EQ(changes[3].t, 5030u);
+	EXPECT_EQ(changes[3].value, '1');
+	remove(path.c_str());
+}
+
+TEST(Wave, CompressesBlocks) {
+	string path = testing::TempDir() + "compress.lmw";
+	WaveWriter wave;
+	ASSERT_TRUE(wave.create(path, {"clk", "q"}));
+	for (uint64_t t = 1; t <= 100000; t++) {
+		wave.stamp(t*10);
+		wave.change(t%2 == 1 ? '1' : '0', 0);
+		wave.change(t%4 < 2 ? '1' : '0', 1);
+	}
+	wave.close();
+
+	// a regular clock encodes to a couple of bytes per change before zlib
+	FILE *fptr = fopen(path.c_str(), "rb");
+	ASSERT_NE(fptr, nullptr);
+	fseek(fptr, 0, SEEK_END);
+	long size = ftell(fptr);
+	fclose(fptr);
+	EXPECT_LT(size, 40000);
+
+	vector<string> names;
+	std::vector<Change> changes = readAll(path, 999995, 1000000, names);
+	// the state at the start, then both signals at the last step
+	ASSERT_EQ(changes.size(), 4u);
+	EXPECT_EQ(changes[0].value, '1');
+	EXPECT_EQ(changes[2].t, 1000000u);
+	EXPECT_EQ(changes[2].value, '0');
+	remove(path.c_str());
+}